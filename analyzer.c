@@ -5,58 +5,51 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
 
-const Type PRIMITIVE_TYPES[] = PRIMITIVE_TYPES_ARRAY();
+// interned in Analyzer_init, indexed by *_TYPE_IDX
+Type PRIMITIVE_TYPE_DEFS[] = PRIMITIVE_TYPES_ARRAY();
+TypeId PRIMITIVE_TYPES[sizeof(PRIMITIVE_TYPE_DEFS) / sizeof(PRIMITIVE_TYPE_DEFS[0])];
+TypeId BOOL_TYPE_ID;
+TypeId NUMBER_TYPE_ID;
+char* LENGTH_IDENT;
 
-Type* CURR_RETURN_TYPE;
+_Thread_local TypeId CURR_RETURN_TYPE;
 
+// see Ast_error, analyzer workers keep the error instead of exiting
 #define ASSERT(expr, fmt, ...) { \
     if (!expr) { \
-        printf(fmt "\n", ##__VA_ARGS__); \
-        exit(-1); \
+        Ast_error(fmt "\n", ##__VA_ARGS__); \
     } \
 }
 //*(int*)0 = 0; \
 
 #define PANIC(fmt, ...) { \
-    printf(fmt "\n", ##__VA_ARGS__); \
-    exit(-1); \
+    Ast_error(fmt "\n", ##__VA_ARGS__); \
 }
 
-Analyzer anlz;
-int get_type_err; // 0 - OK , -1 - NOT FOUND
+// every analyzer thread has its own scopes, see analyze_program_ast
+_Thread_local Analyzer anlz;
 
 void Analyzer_init() {
+    for (size_t i = 0; i < sizeof(PRIMITIVE_TYPE_DEFS) / sizeof(PRIMITIVE_TYPE_DEFS[0]); i++) {
+        PRIMITIVE_TYPE_DEFS[i].type_name = Intern(PRIMITIVE_TYPE_DEFS[i].type_name);
+        PRIMITIVE_TYPES[i] = Type_intern(PRIMITIVE_TYPE_DEFS[i]);
+        Type_add_named(PRIMITIVE_TYPES[i]);
+    }
+    BOOL_TYPE_ID   = Type_intern(Type_new(NULL,BOOL_TYPE));
+    NUMBER_TYPE_ID = Type_intern(Type_new(NULL,NUMBER_TYPE));
+    LENGTH_IDENT = Intern("length");
+
     Analyzer analyzer;
         analyzer.declared_vars = Stack_new();
-        analyzer.types_idx = sizeof(PRIMITIVE_TYPES) / sizeof(PRIMITIVE_TYPES[0]);
-    for (size_t i = 0; i < analyzer.types_idx; i++) {
-        analyzer.types[i] = PRIMITIVE_TYPES[i];
-    }
+        analyzer.func_frame    = 0;
+        analyzer.globals_num   = 0;
+        analyzer.functions_num = 0;
     anlz = analyzer;
 }
 
-
-void Analyzer_append_type(Type type) {
-    if( anlz.types_idx < 1000 ) {
-        anlz.types[anlz.types_idx++] = type;
-    } else {
-        PANIC("Max number of types exceeded");
-    }
-}
-
-Type Analyzer_get_type(char* type_name,int* err) {
-    for( int i = 0 ; i < anlz.types_idx ; i++ ) {
-        char* curr = anlz.types[i].type_name;
-        if( strcmp(type_name,curr) == 0 ) {
-            *err = 0;
-            return anlz.types[i];
-        }
-    }
-    *err = -1;
-    //PANIC("%s %d: Type not found in Analyzer_get_type(): %s",__FILE__,__LINE__,type_name);
-}
-
 int type_is_impl(const char* type, ...) {
     va_list args;
     va_start(args,type);
@@ -84,110 +77,191 @@ const char* format_ast_type(AstExpr* stm) {
         case AST_EXPRESSION_STATEMENT:  return "AST_EXPRESSION_STATEMENT";
         case AST_BINARY_OPERATION:      return "AST_BINARY_OPERATION";
         case AST_STRUCT_DECLARATION:    return "AST_STRUCT_DECLARATION";
+        case AST_LAZY_BLOCK:            return "AST_LAZY_BLOCK";
         default:
             PANIC("UNKNOWKN AST NODE TYPE");
         }
 }
 
-Variable Variable_new(Type type, char* ident) {
+Variable Variable_new(TypeId type, char* ident) {
     Variable var;
-        var.ident = ident;
-        var.type  = type;
+        var.ident    = ident;
+        var.type     = type;
+        var.shadowed = -1;
+        var.binding  = (Binding){ .kind = BINDING_NONE };
     return var;
 }
 
+// binding of a var about to be appended to declared_vars
+static Binding Analyzer_bind_var() {
+    if( anlz.declared_vars.frames_idx <= 1 ) {
+        return (Binding){ .kind = BINDING_GLOBAL, .index = anlz.globals_num++ };
+    }
+    return (Binding){ .kind = BINDING_LOCAL, .index = anlz.declared_vars.pointer - anlz.func_frame };
+}
+
 Stack Stack_new() {
     Stack stk;
-        stk.pointer = 0;
-        stk.frames[0] = 0;
+        stk.pointer    = 0;
+        stk.vars_cap   = 64;
+        stk.vars       = (Variable*)malloc(sizeof(Variable)*stk.vars_cap);
+        stk.frames_cap = 16;
+        stk.frames     = (int*)malloc(sizeof(int)*stk.frames_cap);
+        stk.frames[0]  = 0;
         stk.frames_idx = 1;
+        stk.slots_cap  = 64;
+        stk.slots_used = 0;
+        stk.slots      = (StackSlot*)calloc(stk.slots_cap,sizeof(StackSlot));
+    ASSERT( (stk.vars != NULL && stk.frames != NULL && stk.slots != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
     return stk;
 }
 
+void Stack_free(Stack* stk) {
+    free(stk->vars);
+    free(stk->frames);
+    free(stk->slots);
+}
+
+// deep copy, analyzer workers start from a copy of the global scope
+Stack Stack_copy(Stack* stk) {
+    Stack copy = *stk;
+        copy.vars   = (Variable*)malloc(sizeof(Variable)*copy.vars_cap);
+        copy.frames = (int*)malloc(sizeof(int)*copy.frames_cap);
+        copy.slots  = (StackSlot*)malloc(sizeof(StackSlot)*copy.slots_cap);
+    ASSERT( (copy.vars != NULL && copy.frames != NULL && copy.slots != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    memcpy(copy.vars,  stk->vars,  sizeof(Variable)*stk->pointer);
+    memcpy(copy.frames,stk->frames,sizeof(int)*stk->frames_idx);
+    memcpy(copy.slots, stk->slots, sizeof(StackSlot)*stk->slots_cap);
+    return copy;
+}
+
+static size_t Stack_hash(char* ident) {
+    return Intern_hash(ident);
+}
+
+// slot of ident, an empty slot if ident was never declared
+static StackSlot* Stack_slot(Stack* stk, char* ident) {
+    size_t mask = stk->slots_cap - 1;
+    size_t i = Stack_hash(ident) & mask;
+    while( stk->slots[i].ident != NULL && stk->slots[i].ident != ident ) {
+        i = (i + 1) & mask;
+    }
+    return &stk->slots[i];
+}
+
+static void Stack_grow_slots(Stack* stk) {
+    StackSlot* old     = stk->slots;
+    int        old_cap = stk->slots_cap;
+    stk->slots_cap *= 2;
+    stk->slots = (StackSlot*)calloc(stk->slots_cap,sizeof(StackSlot));
+    ASSERT( (stk->slots != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    for( int i = 0; i < old_cap; i++ ) {
+        if( old[i].ident != NULL ) {
+            *Stack_slot(stk,old[i].ident) = old[i];
+        }
+    }
+    free(old);
+}
+
 void Stack_new_frame(Stack* stk) {
-    ASSERT( (stk->frames_idx < FRAMES_NUM ) , "TO MANY FRAMES: frame ptr: %d",stk->frames_idx);
+    if( stk->frames_idx == stk->frames_cap ) {
+        stk->frames_cap *= 2;
+        stk->frames = (int*)realloc(stk->frames,sizeof(int)*stk->frames_cap);
+        ASSERT( (stk->frames != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    }
     stk->frames[stk->frames_idx++] = stk->pointer;
 }
 void Stack_pop_frame(Stack* stk) {
-    if( stk->pointer == 0 ) {
+    if( stk->frames_idx <= 1 ) {
         PANIC("NO FRAME TO POP");
     } 
-    stk->pointer = stk->frames[--stk->frames_idx];
+    int frame = stk->frames[--stk->frames_idx];
+    for( int i = stk->pointer - 1; i >= frame; i-- ) {
+        Stack_slot(stk,stk->vars[i].ident)->top = stk->vars[i].shadowed;
+    }
+    stk->pointer = frame;
 }
 void Stack_append(Stack* stk, Variable var) {
-    ASSERT( (stk->pointer < VARS_NUM ) , "TO MANY VARS: stk ptr: %d", stk->pointer);
+    if( stk->pointer == stk->vars_cap ) {
+        stk->vars_cap *= 2;
+        stk->vars = (Variable*)realloc(stk->vars,sizeof(Variable)*stk->vars_cap);
+        ASSERT( (stk->vars != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    }
+    StackSlot* slot = Stack_slot(stk,var.ident);
+    if( slot->ident == NULL ) {
+        if( (stk->slots_used + 1) * 2 > stk->slots_cap ) {
+            Stack_grow_slots(stk);
+            slot = Stack_slot(stk,var.ident);
+        }
+        slot->ident = var.ident;
+        slot->top   = -1;
+        stk->slots_used++;
+    }
+    var.shadowed = slot->top;
+    slot->top = stk->pointer;
     stk->vars[stk->pointer++] = var;
 }
 int Stack_find(Stack* stk, char* ident) {
-    for( int i = stk->pointer - 1; i >= 0; i-- ) {
-        if( strcmp(ident,stk->vars[i].ident) == 0 ) {
-            return 1;
-        }
-    }
-    return 0;
+    StackSlot* slot = Stack_slot(stk,ident);
+    return slot->ident != NULL && slot->top >= 0;
 }
 Variable Stack_get(Stack* stk, char* ident) {
-    for( int i = stk->pointer - 1; i >= 0; i-- ) {
-        if( strcmp(ident,stk->vars[i].ident) == 0 ) {
-            return stk->vars[i]; 
-        }
+    StackSlot* slot = Stack_slot(stk,ident);
+    if( slot->ident == NULL || slot->top < 0 ) {
+        PANIC("%s %d: Not found in stack",__FILE__,__LINE__);
     }
-    PANIC("%s %d: Not found in stack",__FILE__,__LINE__);
+    return stk->vars[slot->top];
 }
 int Stack_curr_frame(Stack* stk) {
     return stk->frames[stk->frames_idx -1];
 }
 int Stack_find_curr_frame(Stack* stk, char* ident) {
-    for( int i = stk->pointer - 1; i >= Stack_curr_frame(stk); i-- ) {
-        if( strcmp(ident,stk->vars[i].ident) == 0 ) {
-            return 1;
-        }
-    }
-    return 0;
+    StackSlot* slot = Stack_slot(stk,ident);
+    return slot->ident != NULL && slot->top >= Stack_curr_frame(stk);
 }
 
 // ===================================================================
 
-void analyze_func_decl(AstExpr* stm) {
+// Registers the function in the global scope, its body is checked later by
+// analyze_func_body so functions can be called before they are declared
+void analyze_func_sig(AstExpr* stm) {
 
-    char* ident = stm->function_declaration.name;
-    //char* return_type_name = stm->function_declaration.return_type_info.type_name;
+    char* ident = stm->function_declaration->name;
+    //char* return_type_name = stm->function_declaration->return_type_info.type_name;
 
     if( anlz.declared_vars.frames_idx > 1 ) {
         PANIC("Function Declaration not in global scope: %s",ident);
     }
 
-    analyze_type(stm->function_declaration.return_type);
+    int err;
+    TypeId return_type = analyze_type(stm->function_declaration->return_type,&err);
+    stm->function_declaration->return_type = Type_get(return_type);
 
     Type func_type = Type_new(ident,FUNCTION_TYPE);
-    func_type.function_type.return_type = stm->function_declaration.return_type;
-
-    CURR_RETURN_TYPE = func_type.function_type.return_type;
+    func_type.function_type.return_type = Type_get(return_type);
 
     //Type* return_type = (Type*)malloc(sizeof(Type));
     //*return_type = create_type_from_ast_node(stm);
     //func_type.function_type.return_type = return_type;
     
 
-    Variable function_var = Variable_new(func_type,ident);
-
-    if( Stack_find(&anlz.declared_vars,function_var.ident) ) {
+    if( Stack_find(&anlz.declared_vars,ident) ) {
         PANIC("Redefinition of ident \"%s\" as a function",ident);
     }
     
-    if( stm->function_declaration.args == NULL ) {
-        function_var.type.function_type.arg_types = NULL;
+    if( stm->function_declaration->args == NULL ) {
+        func_type.function_type.arg_types = NULL;
     } else {
         TypeListNode* curr = (TypeListNode*)malloc(sizeof(TypeListNode));
-        function_var.type.function_type.arg_types = curr; 
+        func_type.function_type.arg_types = curr; 
      
-        AstExpr* decl_arg = stm->function_declaration.args;
+        AstExpr* decl_arg = stm->function_declaration->args;
         while(1) { // Typing argument declarations
 
             char* ident = decl_arg->argument_decl.ident;
 
-            analyze_type(decl_arg->argument_decl.type);
-            Type decl_arg_type = *decl_arg->argument_decl.type;
+            TypeId decl_arg_type = analyze_type(decl_arg->argument_decl.type,&err);
+            decl_arg->argument_decl.type = Type_get(decl_arg_type);
             
             decl_arg = decl_arg->argument_decl.next;
             
@@ -201,26 +275,38 @@ void analyze_func_decl(AstExpr* stm) {
         }
     }
 
+    // function types are interned by name, names cant be redefined
+    Variable function_var = Variable_new(Type_intern(func_type),ident);
+        function_var.binding = (Binding){ .kind = BINDING_FUNCTION, .index = anlz.functions_num++ };
     Stack_append(&anlz.declared_vars,function_var);
+}
+// expects analyze_func_sig(stm) to have run, only reads the global scope
+void analyze_func_body(AstExpr* stm) {
     Stack_new_frame(&anlz.declared_vars);
+    anlz.func_frame = anlz.declared_vars.pointer;
+    CURR_RETURN_TYPE = stm->function_declaration->return_type->id;
 
-    AstExpr*      arg           = stm->function_declaration.args;
-    TypeListNode* arg_type_node = function_var.type.function_type.arg_types;
-
+    AstExpr* arg = stm->function_declaration->args;
     while( arg != NULL ) { // Adding function args to the function scope
         char* ident = arg->argument_decl.ident;
 
-        Variable var = Variable_new(arg_type_node->type,ident);
+        Variable var = Variable_new(arg->argument_decl.type->id,ident);
+            var.binding = Analyzer_bind_var();
         Stack_append(&anlz.declared_vars,var);
 
-        arg_type_node = arg_type_node->next;
-        arg           = arg->argument_decl.next;
+        arg = arg->argument_decl.next;
     }
 
-    // analyze fn body
-    analyze_statements(stm->function_declaration.body->block_statement.statements); 
+    // analyze fn body, bodies that main cant reach or that come from the incremental cache are never parsed
+    if( Ast_func_reached(stm) && !Ast_func_cached(stm) ) {
+        analyze_statements(Ast_func_body(stm)->block_statement.statements); 
+    }
     Stack_pop_frame(&anlz.declared_vars);
 }
+void analyze_func_decl(AstExpr* stm) {
+    analyze_func_sig(stm);
+    analyze_func_body(stm);
+}
 void analyze_block(AstExpr* stm) {
     Stack_new_frame(&anlz.declared_vars);
     analyze_statements(stm->block_statement.statements); 
@@ -231,48 +317,47 @@ void analyze_block(AstExpr* stm) {
 //  banana : int;
 //  banana := 5;     
 void analyze_decl(AstExpr* stm) {
-    char* var_ident      = stm->declaration.name;
-    //char* var_type_name  = stm->declaration.type_info.type_name;
+    char* var_ident      = stm->declaration->name;
+    //char* var_type_name  = stm->declaration->type_info.type_name;
 
     if( Stack_find_curr_frame(&anlz.declared_vars,var_ident) ) {
         PANIC("Redefinition of a var: %s",var_ident);
     }
 
-    Type expr_type;
-    Type decl_var_type;
+    TypeId expr_type;
+    TypeId decl_var_type;
 
-    if( stm->declaration.type == NULL ){
-        if( stm->declaration.value->expression_statement.value == NULL ) {
+    if( stm->declaration->type == NULL ){
+        if( stm->declaration->value->expression_statement.value == NULL ) {
             // banana := ; ??? should be impossible
             PANIC("%s %d: SHOULD BE UNREACHABLE",__FILE__,__LINE__);
             PANIC("Declaration of a variable '%s' without specified type",var_ident);
         }
             // banana := 5;
-        expr_type = analyze_expr_statement(stm->declaration.value);
+        expr_type = analyze_expr_statement(stm->declaration->value);
 
     } else {
-        int err = analyze_type(stm->declaration.type);
+        int err;
+        decl_var_type = analyze_type(stm->declaration->type,&err);
 
-        decl_var_type = *stm->declaration.type;
-
-        if( stm->declaration.value->expression_statement.value == NULL ) {
+        if( stm->declaration->value->expression_statement.value == NULL ) {
             // 0 == ok, 1== arr len not specified
             ASSERT( (err == 0 ), "Array lenght has to be specified at var declaration if an expression is not provided '%s'",var_ident);
             // banana :int ;
             expr_type = decl_var_type;
         } else {
             // banana :int = "HELLO";
-            expr_type = analyze_expr_statement(stm->declaration.value);
+            expr_type = analyze_expr_statement(stm->declaration->value);
             // allowed 1,3
-            int type_cmp_err = Type_cmp(&decl_var_type,&expr_type);
+            int type_cmp_err = Type_cmp(decl_var_type,expr_type);
             if( type_cmp_err != 1 && type_cmp_err != 3) {
                 StringBuilder expr_sb = sb_new();
-                 print_expr_to_sb(&expr_sb,stm->declaration.value->expression_statement.value);
+                 print_expr_to_sb(&expr_sb,stm->declaration->value->expression_statement.value);
 
                 StringBuilder decl_type_sb = sb_new();
-                 Type_build_type_string(&decl_type_sb,&decl_var_type);
+                 Type_build_type_string(&decl_type_sb,Type_get(decl_var_type));
                 StringBuilder expr_type_sb = sb_new();
-                 Type_build_type_string(&expr_type_sb,&expr_type);
+                 Type_build_type_string(&expr_type_sb,Type_get(expr_type));
 
                 PANIC("Type specified in the declaration of var '%s' {%s} doesnt match the type of the expr provided: {%s} %s" ,
                            var_ident, 
@@ -290,10 +375,10 @@ void analyze_decl(AstExpr* stm) {
     printf("ANALYZER: %s : %s = %s\n",var_ident,decl_type_sb.buffer,expr_type_sb.buffer);
     */
 
-    stm->declaration.type = (Type*)malloc(sizeof(Type));
-    *stm->declaration.type = expr_type;
+    stm->declaration->type = Type_get(expr_type);
 
     Variable var = Variable_new(expr_type,var_ident);
+        var.binding = Analyzer_bind_var();
     Stack_append(&anlz.declared_vars,var);
 }
 void analyze_if(AstExpr* stm) {
@@ -301,50 +386,53 @@ void analyze_if(AstExpr* stm) {
         PANIC("'if' statement in global scope");
     }
     ASSERT( (stm->if_statement.condition->type == AST_EXPRESSION_STATEMENT), "Expression statement expected as IF condition");
-    Type condition_type = analyze_expr_statement(stm->if_statement.condition);
-    if(condition_type.type_kind != BOOL_TYPE ){
+    TypeId condition_type = analyze_expr_statement(stm->if_statement.condition);
+    if( condition_type != BOOL_TYPE_ID ){
         StringBuilder expr_sb = sb_new();
         print_expr_to_sb(&expr_sb,stm->if_statement.condition->expression_statement.value);
 
         StringBuilder condition_type_sb = sb_new();
-         Type_build_type_string(&condition_type_sb,&condition_type);
+         Type_build_type_string(&condition_type_sb,Type_get(condition_type));
         PANIC("Expression statement has to evaluate to BOOL_TYPE, got: {%s} '%s'",condition_type_sb.buffer,expr_sb.buffer);
     }
 
     analyze_statements(stm->if_statement.body);
 }
-Type analyze_func_call(AstExpr* stm) {
+TypeId analyze_func_call(AstExpr* stm) {
     Variable var;
-    char* ident = stm->func_call.identifier.value;  
+    Type* func_type;
+    char* ident = stm->func_call.name;  
     if( !Stack_find(&anlz.declared_vars, ident) ) {
         PANIC("Use of undeclered function: %s",ident);
     } else {
         var = Stack_get(&anlz.declared_vars, ident);
-        if( var.type.type_kind != FUNCTION_TYPE ) {
-            PANIC("Tried to call variable '%s' of type {%s} as a function",var.ident,var.type.type_name);
+        func_type = Type_get(var.type);
+        if( func_type->type_kind != FUNCTION_TYPE ) {
+            PANIC("Tried to call variable '%s' of type {%s} as a function",var.ident,func_type->type_name);
         }
+        stm->func_call.binding = var.binding;
     }
     int arg_counter = 1;
     AstExpr* curr_arg = stm->func_call.args;
-    TypeListNode* curr_arg_decl = var.type.function_type.arg_types;
+    TypeListNode* curr_arg_decl = func_type->function_type.arg_types;
     while(1) {
         if( curr_arg == NULL ) {
             break;
         }
-        Type arg_type      = analyze_expr_statement(curr_arg->argument.value);
+        TypeId arg_type      = analyze_expr_statement(curr_arg->argument.value);
         if( curr_arg_decl == NULL ) {
-            PANIC("In call to function '%s' expected %d argument/s got additianal argument of type {%s}",var.ident,arg_counter,arg_type.type_name);
+            PANIC("In call to function '%s' expected %d argument/s got additianal argument of type {%s}",var.ident,arg_counter,Type_get(arg_type)->type_name);
         }
-        Type arg_decl_type = curr_arg_decl->type;
-        int type_cmp_err =Type_cmp(&arg_decl_type,&arg_type);
+        TypeId arg_decl_type = curr_arg_decl->type;
+        int type_cmp_err =Type_cmp(arg_decl_type,arg_type);
         if( type_cmp_err != 1 && type_cmp_err != 3) {
             StringBuilder expr_sb = sb_new();
             print_expr_to_sb(&expr_sb,curr_arg->argument.value->expression_statement.value);
 
             StringBuilder decl_arg_type_sb = sb_new();
-             Type_build_type_string(&decl_arg_type_sb,&arg_decl_type);
+             Type_build_type_string(&decl_arg_type_sb,Type_get(arg_decl_type));
             StringBuilder arg_type_sb = sb_new();
-             Type_build_type_string(&arg_type_sb,&arg_type);
+             Type_build_type_string(&arg_type_sb,Type_get(arg_type));
             PANIC("In call to function '%s' argument number:%d doesnt match the argument declaration. Expected {%s} and got {%s} '%s'",
                   var.ident,
                   arg_counter,
@@ -357,18 +445,18 @@ Type analyze_func_call(AstExpr* stm) {
         curr_arg_decl = curr_arg_decl->next;
         curr_arg = curr_arg->argument.next;
     }
-    return *var.type.function_type.return_type;
+    return func_type->function_type.return_type->id;
 }
 
 // returns the type of the analyzed expr
-Type analyze_expr_statement(AstExpr* stm) {
-    Type type = analyze_expr_statement_inner(stm->expression_statement.value);
-    stm->expression_statement.type = type;
+TypeId analyze_expr_statement(AstExpr* stm) {
+    TypeId type = analyze_expr_statement_inner(stm->expression_statement.value);
+    *Ast_type(stm) = type;
     //stm->expression_statement.type_name = type.type_name;
     return type;
 }
 
-Type analyze_expr_statement_inner(AstExpr* stm) {
+TypeId analyze_expr_statement_inner(AstExpr* stm) {
     switch(stm->type) {
         char* ident;
         case AST_NUMBER:
@@ -379,79 +467,73 @@ Type analyze_expr_statement_inner(AstExpr* stm) {
                 PANIC("Use of undeclered var: %s",ident);
             } else {
                 Variable var = Stack_get(&anlz.declared_vars, ident);
-                stm->identifier.type = var.type;
+                stm->identifier.binding = var.binding;
+                *Ast_type(stm) = var.type;
                 return var.type;
             }
         case AST_FUNC_CALL:
             return analyze_func_call(stm); 
         case AST_STRING:
-            Type ptr_type = Type_new(NULL,POINTER_TYPE);
-            ptr_type.pointer_type.sub_type = (Type*)malloc(sizeof(Type));
-            *ptr_type.pointer_type.sub_type = PRIMITIVE_TYPES[CHAR_TYPE_IDX];
-            return ptr_type;
+            return Type_pointer_to(PRIMITIVE_TYPES[CHAR_TYPE_IDX]);
     }
     if( stm->type == AST_UNARY_OPERATION ) {
-        Type type = analyze_expr_statement_inner(stm->unary_operation.right);
-        switch( stm->unary_operation.opp_token.kind ) {
+        TypeId type = analyze_expr_statement_inner(stm->unary_operation.right);
+        switch( stm->unary_operation.opp ) {
             case NOT:
-                if( type.type_kind != BOOL_TYPE ) {
+                if( type != BOOL_TYPE_ID ) {
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
 
                     StringBuilder type_sb = sb_new();
-                     Type_build_type_string(&type_sb,&type);
+                     Type_build_type_string(&type_sb,Type_get(type));
                     PANIC("attemted to NOT a type (%s) thats not a bool %s",type_sb.buffer,expr_sb.buffer);
                 } 
-                return Type_new(NULL,BOOL_TYPE);
+                return BOOL_TYPE_ID;
             case MINUS:
-                if( !Type_cmp(&type,&PRIMITIVE_TYPES[INT_TYPE_IDX]) && !Type_cmp(&type,&PRIMITIVE_TYPES[FLOAT_TYPE_IDX]) ) {
-                    PANIC("attemted to MINUS a type (%s) thats not a number",type.type_name);
+                if( !Type_cmp(type,PRIMITIVE_TYPES[INT_TYPE_IDX]) && !Type_cmp(type,PRIMITIVE_TYPES[FLOAT_TYPE_IDX]) ) {
+                    PANIC("attemted to MINUS a type (%s) thats not a number",Type_get(type)->type_name);
                 }
-                return Type_new(NULL,NUMBER_TYPE);
+                return NUMBER_TYPE_ID;
             case PLUS_PLUS:
-                if( !Type_cmp(&type,&PRIMITIVE_TYPES[INT_TYPE_IDX]) && !Type_cmp(&type,&PRIMITIVE_TYPES[FLOAT_TYPE_IDX]) ) {
-                    PANIC("attemted to PLUS_PLUS a type (%s) thats not a number",type.type_name);
+                if( !Type_cmp(type,PRIMITIVE_TYPES[INT_TYPE_IDX]) && !Type_cmp(type,PRIMITIVE_TYPES[FLOAT_TYPE_IDX]) ) {
+                    PANIC("attemted to PLUS_PLUS a type (%s) thats not a number",Type_get(type)->type_name);
                 }
-                return Type_new(NULL,NUMBER_TYPE);
+                return NUMBER_TYPE_ID;
             case MINUS_MINUS:
-                if( !Type_cmp(&type,&PRIMITIVE_TYPES[INT_TYPE_IDX]) && !Type_cmp(&type,&PRIMITIVE_TYPES[FLOAT_TYPE_IDX]) ) {
-                    PANIC("attemted to MINUS_MINUS a type (%s) thats not a number",type.type_name);
+                if( !Type_cmp(type,PRIMITIVE_TYPES[INT_TYPE_IDX]) && !Type_cmp(type,PRIMITIVE_TYPES[FLOAT_TYPE_IDX]) ) {
+                    PANIC("attemted to MINUS_MINUS a type (%s) thats not a number",Type_get(type)->type_name);
                 }
-                return Type_new(NULL,NUMBER_TYPE);
+                return NUMBER_TYPE_ID;
             case AMPERSAND:
-                if( !Type_is_lvalue(&type) ){
+                if( !Type_is_lvalue(type) ){
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
 
                     StringBuilder type_sb = sb_new();
-                     Type_build_type_string(&type_sb,&type);
+                     Type_build_type_string(&type_sb,Type_get(type));
                     PANIC("got {%s} but lvalue required as '&' operand %s",type_sb.buffer,expr_sb.buffer);
                 }
-                Type ptr_type = Type_new(NULL,POINTER_TYPE);
-                ptr_type.pointer_type.sub_type = (Type*)malloc(sizeof(Type));
-                *ptr_type.pointer_type.sub_type = type;
-                return ptr_type;
+                return Type_pointer_to(type);
             case STAR:
-                if( type.type_kind != POINTER_TYPE ) {
+                if( Type_get(type)->type_kind != POINTER_TYPE ) {
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
 
                     StringBuilder type_sb = sb_new();
-                     Type_build_type_string(&type_sb,&type);
+                     Type_build_type_string(&type_sb,Type_get(type));
                     PANIC("attempted to dereference a {%s} type thats not a pointer %s",type_sb.buffer,expr_sb.buffer);
                 }
-                Type derefed_type = *type.pointer_type.sub_type;
-                return derefed_type;
+                return Type_get(type)->pointer_type.sub_type->id;
             default: 
                 PANIC("%s %d: Panicked",__FILE__,__LINE__);
         }
         return type;
     } else
     if( stm->type == AST_BINARY_OPERATION ) {
-        Type left_type  ;
-        Type right_type ;
+        TypeId left_type  ;
+        TypeId right_type ;
         // TODO
-        switch( stm->binary_operation.opp_token.kind ) {
+        switch( stm->binary_operation.opp ) {
             // same type return type
             case STAR:
             case PLUS:
@@ -459,10 +541,10 @@ Type analyze_expr_statement_inner(AstExpr* stm) {
             case MINUS:
                 left_type  = analyze_expr_statement_inner(stm->binary_operation.left);
                 right_type = analyze_expr_statement_inner(stm->binary_operation.right);
-                if( Type_cmp(&left_type,&right_type) != 1) {
-                    PANIC("Tried to %s {%s} and {%s} witch are not the same type",format_enum(stm->binary_operation.opp_token),left_type.type_name,right_type.type_name);
+                if( Type_cmp(left_type,right_type) != 1) {
+                    PANIC("Tried to %s {%s} and {%s} witch are not the same type",format_enum((Token){ .kind = stm->binary_operation.opp }),Type_get(left_type)->type_name,Type_get(right_type)->type_name);
                 }
-                stm->binary_operation.type = left_type;
+                *Ast_type(stm) = left_type;
                 return left_type;
 
             // same type return bool
@@ -474,18 +556,18 @@ Type analyze_expr_statement_inner(AstExpr* stm) {
             case MORE_EQUAL:
                 left_type  = analyze_expr_statement_inner(stm->binary_operation.left);
                 right_type = analyze_expr_statement_inner(stm->binary_operation.right);
-                if( Type_cmp(&left_type,&right_type) != 1) {
+                if( Type_cmp(left_type,right_type) != 1) {
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
 
                     StringBuilder left_type_sb = sb_new();
-                     Type_build_type_string(&left_type_sb,&left_type);
+                     Type_build_type_string(&left_type_sb,Type_get(left_type));
                     StringBuilder right_type_sb = sb_new();
-                     Type_build_type_string(&right_type_sb,&right_type);
-                    PANIC("Tried to %s {%s} and {%s} witch are not the same type %s",format_enum(stm->binary_operation.opp_token),left_type_sb.buffer,right_type_sb.buffer,expr_sb.buffer);
+                     Type_build_type_string(&right_type_sb,Type_get(right_type));
+                    PANIC("Tried to %s {%s} and {%s} witch are not the same type %s",format_enum((Token){ .kind = stm->binary_operation.opp }),left_type_sb.buffer,right_type_sb.buffer,expr_sb.buffer);
                 }
-                stm->binary_operation.type = Type_new(NULL,BOOL_TYPE);
-                return Type_new(NULL,BOOL_TYPE);
+                *Ast_type(stm) = BOOL_TYPE_ID;
+                return BOOL_TYPE_ID;
 
             // same type and return VOID type
             // (a = a + b) ; type_of( (a = b) ) == VOID
@@ -493,19 +575,19 @@ Type analyze_expr_statement_inner(AstExpr* stm) {
                 left_type  = analyze_expr_statement_inner(stm->binary_operation.left);
                 right_type = analyze_expr_statement_inner(stm->binary_operation.right);
                 // allowed 1,3
-                int type_cmp_err = Type_cmp(&left_type,&right_type);
+                int type_cmp_err = Type_cmp(left_type,right_type);
                 if( type_cmp_err != 1 && type_cmp_err != 3) {
                 //if( Type_cmp(&left_type,&right_type) != 1) {
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
 
                     StringBuilder left_type_sb = sb_new();
-                     Type_build_type_string(&left_type_sb,&left_type);
+                     Type_build_type_string(&left_type_sb,Type_get(left_type));
                     StringBuilder right_type_sb = sb_new();
-                     Type_build_type_string(&right_type_sb,&right_type);
+                     Type_build_type_string(&right_type_sb,Type_get(right_type));
                     PANIC("Tried to ASSIGN {%s} to {%s} %s", right_type_sb.buffer, left_type_sb.buffer, expr_sb.buffer);
                 }
-                stm->binary_operation.type = PRIMITIVE_TYPES[VOID_TYPE_IDX];
+                *Ast_type(stm) = PRIMITIVE_TYPES[VOID_TYPE_IDX];
                 return PRIMITIVE_TYPES[VOID_TYPE_IDX];
 
 
@@ -516,12 +598,12 @@ Type analyze_expr_statement_inner(AstExpr* stm) {
             // left side can be any type but a STRUCT_TYPE is the only valid type
             case DOT: 
                 left_type  = analyze_expr_statement_inner(stm->binary_operation.left);
-                if( left_type.type_kind != STRUCT_TYPE && left_type.type_kind != ARRAY_TYPE) {
+                if( Type_get(left_type)->type_kind != STRUCT_TYPE && Type_get(left_type)->type_kind != ARRAY_TYPE) {
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
 
                     StringBuilder left_type_sb = sb_new();
-                     Type_build_type_string(&left_type_sb,&left_type);
+                     Type_build_type_string(&left_type_sb,Type_get(left_type));
                     PANIC("Tried to use DOT operator on {%s} %s", left_type_sb.buffer, expr_sb.buffer);
                 }
 
@@ -530,14 +612,22 @@ Type analyze_expr_statement_inner(AstExpr* stm) {
                     ASSERT( (field_name_identifier->type == AST_IDENTIFIER), "Only an identifier can be a field name", "");
                 char* field_name = field_name_identifier->identifier.token.value;
 
-                if( left_type.type_kind == ARRAY_TYPE ) {
-                    if( strcmp(field_name,"length") != 0 ) {
+                TypeId field_type;
+                if( Type_get(left_type)->type_kind == ARRAY_TYPE ) {
+                    if( field_name != LENGTH_IDENT ) {
                         PANIC("Unknown array atribute %s",field_name);
                     }
+                    field_name_identifier->identifier.binding = (Binding){ .kind = BINDING_LENGTH };
+                    field_type = PRIMITIVE_TYPES[INT_TYPE_IDX];
+                } else {
+                    StructField* field = Type_find_field(left_type,field_name);
+                    if( field == NULL ) {
+                        PANIC("Field not found '%s' in struct {%s}",field_name,Type_get(left_type)->type_name);
+                    }
+                    field_name_identifier->identifier.binding = (Binding){ .kind = BINDING_FIELD, .index = field - Type_get(left_type)->struct_type.fields };
+                    field_type = field->type;
                 }
-
-                Type field_type = Type_get_field_type(left_type,field_name);
-                stm->binary_operation.type = field_type;
+                *Ast_type(stm) = field_type;
                 return field_type;
             // right side has to be an intiger
             case SUBSCRIPT_OPEN: 
@@ -545,27 +635,27 @@ Type analyze_expr_statement_inner(AstExpr* stm) {
                 //if( left_type.array_type.sub_type->type_kind == ARRAY_TYPE ) {
                     //PANIC("Multidimentional arrays not supported");
                 //}
-                if( left_type.type_kind != ARRAY_TYPE ) {
+                if( Type_get(left_type)->type_kind != ARRAY_TYPE ) {
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
 
                     StringBuilder left_type_sb = sb_new();
-                     Type_build_type_string(&left_type_sb,&left_type);
+                     Type_build_type_string(&left_type_sb,Type_get(left_type));
                     PANIC("Tried to index {%s} %s", left_type_sb.buffer, expr_sb.buffer);
                 }
                 right_type = analyze_expr_statement_inner(stm->binary_operation.right);
-                if( !Type_cmp(&right_type,&PRIMITIVE_TYPES[INT_TYPE_IDX]) ) {
+                if( !Type_cmp(right_type,PRIMITIVE_TYPES[INT_TYPE_IDX]) ) {
                     StringBuilder expr_sb = sb_new();
                      print_expr_to_sb(&expr_sb,stm);
                     StringBuilder left_type_sb = sb_new();
-                     Type_build_type_string(&left_type_sb,left_type.array_type.sub_type);
+                     Type_build_type_string(&left_type_sb,Type_get(left_type)->array_type.sub_type);
                     StringBuilder right_type_sb = sb_new();
-                     Type_build_type_string(&right_type_sb,&right_type);
+                     Type_build_type_string(&right_type_sb,Type_get(right_type));
 
                     PANIC("Tried to index An array of {%s} with {%s} only intigers allowed %s", left_type_sb.buffer, right_type_sb.buffer,expr_sb.buffer);
                 }
-                stm->binary_operation.type = *left_type.array_type.sub_type;
-                return *left_type.array_type.sub_type;
+                *Ast_type(stm) = Type_get(left_type)->array_type.sub_type->id;
+                return Type_get(left_type)->array_type.sub_type->id;
 
             default:
                 PANIC("");
@@ -581,11 +671,11 @@ void analyze_for(AstExpr* stm) {
     }
     Stack_new_frame(&anlz.declared_vars);
 
-    analyze_statements(stm->for_statement.initial);
-    analyze_statements(stm->for_statement.condition);
-    analyze_statements(stm->for_statement.iteration);
+    analyze_statements(stm->for_statement->initial);
+    analyze_statements(stm->for_statement->condition);
+    analyze_statements(stm->for_statement->iteration);
 
-    analyze_statements(stm->for_statement.body->block_statement.statements); 
+    analyze_statements(stm->for_statement->body->block_statement.statements); 
     Stack_pop_frame(&anlz.declared_vars);
 }
 
@@ -600,7 +690,7 @@ void analyze_return(AstExpr* stm) {
     if( anlz.declared_vars.frames_idx <= 1 ) {
         PANIC("'return' statement in global scope");
     }
-    Type type;
+    TypeId type;
     if( stm->return_statement.expression == NULL ) {
         type = PRIMITIVE_TYPES[VOID_TYPE_IDX];
     } else { 
@@ -608,14 +698,14 @@ void analyze_return(AstExpr* stm) {
         type = analyze_expr_statement(stm->return_statement.expression);
     }
 
-    if( !Type_cmp(&type,CURR_RETURN_TYPE) ) {
+    if( !Type_cmp(type,CURR_RETURN_TYPE) ) {
         //StringBuilder expr_sb = sb_new();
          //print_expr_to_sb(&expr_sb,stm->return_statement.expression->expression_statement.value);
 
         StringBuilder decl_type_sb = sb_new();
-         Type_build_type_string(&decl_type_sb,CURR_RETURN_TYPE);
+         Type_build_type_string(&decl_type_sb,Type_get(CURR_RETURN_TYPE));
         StringBuilder expr_type_sb = sb_new();
-         Type_build_type_string(&expr_type_sb,&type);
+         Type_build_type_string(&expr_type_sb,Type_get(type));
         PANIC("Wrong type in return statement {%s}, expected {%s} ",expr_type_sb.buffer, decl_type_sb.buffer);
     }
 }
@@ -625,42 +715,34 @@ void analyze_struct_decl(AstExpr* stm) {
         PANIC("Struct Declaration not in global scope: %s",struct_name);
     }
 
-    Type t = Analyzer_get_type(struct_name,&get_type_err);
-    if( get_type_err == 0 ) { // Type found 
-        PANIC("Redefinition of type {%s} as a struct",t.type_name);
+    if( Type_find_named(struct_name) != TYPE_NONE ) {
+        PANIC("Redefinition of type {%s} as a struct",struct_name);
     }
 
-    Type struct_type = Type_new(struct_name,STRUCT_TYPE);
-    AstExpr* curr_field = stm->struct_declaration.body->block_statement.statements;
-
-    if( curr_field == NULL ) {
-        struct_type.struct_type.fields = NULL; 
-    } else {
-        FieldListNode* curr_field_node = (FieldListNode*)malloc(sizeof(FieldListNode));
-        struct_type.struct_type.fields = curr_field_node; 
-        while(1) {
-            ASSERT( ( curr_field->type == AST_DECLARATION ),  "Only declarations allowed in struct declaration body");
-            ASSERT( ( curr_field->declaration.type != NULL ), "Type of the field must be specified in struct declaration");
-            char* curr_field_name = curr_field->declaration.name;
-
-            int err = analyze_type(curr_field->declaration.type);
-            ASSERT( (err == 0), "Array lenght has to be specified at struct field declaration '%s'",curr_field_name);
-
-            Type curr_field_type = *curr_field->declaration.type;
-
-            curr_field = curr_field->declaration.next;
+    uint32_t fields_num = 0;
+    for( AstExpr* curr_field = stm->struct_declaration.body->block_statement.statements; curr_field != NULL; curr_field = Ast_next(curr_field) ) {
+        fields_num++;
+    }
 
-            if(curr_field == NULL) {
-                *curr_field_node = (FieldListNode){ .type=curr_field_type, .name = curr_field_name, .next = NULL };
-                break;
-            } else {
-                *curr_field_node = (FieldListNode){ .type=curr_field_type, .name = curr_field_name, .next = (FieldListNode*)malloc(sizeof(FieldListNode)) };
-            }
-            curr_field_node = curr_field_node->next;
-        }
+    StructField* fields = (StructField*)malloc(sizeof(StructField)*(fields_num+1));
+    ASSERT( (fields != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    AstExpr* curr_field = stm->struct_declaration.body->block_statement.statements;
+    for( uint32_t n = 0; n < fields_num; n++ ) {
+        ASSERT( ( curr_field->type == AST_DECLARATION ),  "Only declarations allowed in struct declaration body");
+        ASSERT( ( curr_field->declaration->type != NULL ), "Type of the field must be specified in struct declaration");
+        char* curr_field_name = curr_field->declaration->name;
+
+        int err;
+        TypeId curr_field_type = analyze_type(curr_field->declaration->type,&err);
+        ASSERT( (err == 0), "Array lenght has to be specified at struct field declaration '%s'",curr_field_name);
+        curr_field->declaration->type = Type_get(curr_field_type);
+
+        fields[n] = (StructField){ .type = curr_field_type, .name = curr_field_name };
+        curr_field = curr_field->declaration->next;
     }
 
-    Analyzer_append_type(struct_type);
+    Type_add_named(Type_make_struct(struct_name,fields,fields_num));
+    free(fields);
 }
 void analyze_extern_statement(AstExpr* stm) {
     if( anlz.declared_vars.frames_idx > 1 ) {
@@ -682,69 +764,252 @@ void analyze_extern_statement(AstExpr* stm) {
     }
 }
 
+void analyze_statement(AstExpr* stm) {
+    switch( stm->type ) {
+        case AST_FUNCTION_DECLARATION:
+            analyze_func_decl(stm); 
+            break;
+        case AST_BLOCK_STATEMENT:
+            analyze_block(stm); 
+            break;
+        case AST_DECLARATION:
+            analyze_decl(stm); 
+            break;
+        case AST_IF_STATEMENT:
+            analyze_if(stm); 
+            break;
+        case AST_EXPRESSION_STATEMENT:
+            analyze_expr_statement(stm); 
+            break;
+        case AST_FOR_STATEMENT:
+            analyze_for(stm); 
+            break;
+        case AST_WHILE_STATEMENT:
+            analyze_while(stm); 
+            break;
+        case AST_RETURN_STATEMENT:
+            analyze_return(stm); 
+            break;
+        case AST_STRUCT_DECLARATION:    
+            analyze_struct_decl(stm);
+            break;
+        case AST_EXTERN_STATEMENT:    
+            analyze_extern_statement(stm);
+            break;
+
+        default:
+            PANIC("NOT SUPPORTED: %s",format_ast_type(stm));
+    }
+}
 void analyze_statements(AstExpr* stm) {
-    AstExpr* next = stm;
-    while( next != NULL ) {
-        switch( next->type ) {
-            case AST_FUNCTION_DECLARATION:
-                analyze_func_decl(next); 
-                next = next->function_declaration.next;
-                break;
-            case AST_BLOCK_STATEMENT:
-                analyze_block(next); 
-                next = next->block_statement.next;
-                break;
-            case AST_DECLARATION:
-                analyze_decl(next); 
-                next = next->declaration.next;
-                break;
-            case AST_IF_STATEMENT:
-                analyze_if(next); 
-                next = next->if_statement.next;
-                break;
-            case AST_EXPRESSION_STATEMENT:
-                analyze_expr_statement(next); 
-                next = next->expression_statement.next;
-                break;
-            case AST_FOR_STATEMENT:
-                analyze_for(next); 
-                next = next->for_statement.next;
-                break;
-            case AST_WHILE_STATEMENT:
-                analyze_while(next); 
-                next = next->while_statement.next;
+    for( AstExpr* next = stm; next != NULL; next = Ast_next(next) ) {
+        analyze_statement(next);
+    }
+}
+
+typedef struct FuncList {
+    AstExpr** items;
+    int       len;
+    int       cap;
+} FuncList;
+
+#define GLOBAL_PASS_STRUCTS 0
+#define GLOBAL_PASS_FUNCS   1
+#define GLOBAL_PASS_REST    2
+
+// The top level is analyzed in passes so items can be used before they are
+// declared: structs, then function signatures, then global vars and the rest.
+// Function bodies are left for the workers, the functions go to funcs.
+static void analyze_global_items(AstExpr* stm, int pass, FuncList* funcs) {
+    for( ; stm != NULL; stm = Ast_next(stm) ) {
+        switch( stm->type ) {
+            case AST_STRUCT_DECLARATION:
+                if( pass == GLOBAL_PASS_STRUCTS ) {
+                    analyze_struct_decl(stm);
+                }
                 break;
-            case AST_RETURN_STATEMENT:
-                analyze_return(next); 
-                next = next->return_statement.next;
+            case AST_FUNCTION_DECLARATION:
+                if( pass == GLOBAL_PASS_FUNCS ) {
+                    analyze_func_sig(stm);
+                    if( funcs->len == funcs->cap ) {
+                        funcs->cap = funcs->cap == 0 ? 64 : funcs->cap * 2;
+                        funcs->items = (AstExpr**)realloc(funcs->items,sizeof(AstExpr*)*funcs->cap);
+                        ASSERT( (funcs->items != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+                    }
+                    funcs->items[funcs->len++] = stm;
+                }
                 break;
-            case AST_STRUCT_DECLARATION:    
-                analyze_struct_decl(next);
-                next = next->struct_declaration.next;
+            case AST_EXTERN_STATEMENT: {
+                AstExpr* body = stm->extern_statement.body;
+                analyze_global_items(body->type == AST_BLOCK_STATEMENT ? body->block_statement.statements : body,pass,funcs);
                 break;
-            case AST_EXTERN_STATEMENT:    
-                analyze_extern_statement(next);
-                next = next->extern_statement.next;
+            }
+            default:
+                if( pass == GLOBAL_PASS_REST ) {
+                    analyze_statement(stm);
+                }
+        }
+    }
+}
+
+#define ANALYZE_MAX_WORKERS     64
+#define ANALYZE_MIN_CHUNK_FUNCS 256 // less functions per worker arent worth a thread
+#define ANALYZE_BATCH_FUNCS     16  // functions a worker takes at once
+
+// error of the function with the lowest index, so the same error is
+// reported no matter how the functions were split between the workers
+typedef struct AnalyzeError {
+    pthread_mutex_t lock;
+    uint32_t        func; // UINT32_MAX = no error
+    char            message[AST_ERROR_MESSAGE_SIZE];
+} AnalyzeError;
+
+typedef struct AnalyzeWorker {
+    FuncList*     funcs;
+    uint32_t*     next_func; // shared by the workers, first function nobody took yet
+    Stack*        globals;   // read only while the workers run
+    Arena         arena;     // bodies parsed by the worker
+    AnalyzeError* error;
+} AnalyzeWorker;
+
+// 0 if the body is fine, otherwise the error is in AST_ERROR_MESSAGE
+static int analyze_func_body_trapped(AstExpr* func) {
+    jmp_buf trap;
+    if( setjmp(trap) != 0 ) {
+        AST_ERROR_TRAP = NULL;
+        return 1;
+    }
+    AST_ERROR_TRAP = &trap;
+    analyze_func_body(func);
+    AST_ERROR_TRAP = NULL;
+    return 0;
+}
+
+void* analyze_worker(void* arg) {
+    AnalyzeWorker* worker = (AnalyzeWorker*)arg;
+    AnalyzeError*  error  = worker->error;
+    anlz = (Analyzer){ .declared_vars = Stack_copy(worker->globals) };
+    Ast_set_body_arena(&worker->arena);
+
+    // functions are taken in increasing order, once one failed everything
+    // after it is skipped. The ones before it are still checked since one
+    // of them could have an error too
+    while(1) {
+        uint32_t start = __atomic_fetch_add(worker->next_func,ANALYZE_BATCH_FUNCS,__ATOMIC_RELAXED);
+        if( start >= worker->funcs->len || start > __atomic_load_n(&error->func,__ATOMIC_RELAXED) ) {
+            break;
+        }
+        uint32_t end = start + ANALYZE_BATCH_FUNCS;
+        if( end > worker->funcs->len ) {
+            end = worker->funcs->len;
+        }
+        for( uint32_t i = start; i < end; i++ ) {
+            if( i > __atomic_load_n(&error->func,__ATOMIC_RELAXED) ) {
                 break;
+            }
+            if( analyze_func_body_trapped(worker->funcs->items[i]) ) {
+                pthread_mutex_lock(&error->lock);
+                if( i < error->func ) {
+                    memcpy(error->message,AST_ERROR_MESSAGE,AST_ERROR_MESSAGE_SIZE);
+                    __atomic_store_n(&error->func,i,__ATOMIC_RELAXED);
+                }
+                pthread_mutex_unlock(&error->lock);
+                goto done; // the scopes are left half popped, and every later function is skipped anyway
+            }
+        }
+    }
 
-            default:
-                PANIC("NOT SUPPORTED: %s",format_ast_type(next));
+done:
+    Ast_set_body_arena(NULL);
+    Stack_free(&anlz.declared_vars);
+    return NULL;
+}
+
+// Bodies only read the global scope so with enough functions they are checked
+// on worker threads, each with its own copy of the scope stack. The workers
+// dont exit on an error, the error of the first failing function is printed
+// once all of them are joined.
+void analyze_func_bodies(FuncList* funcs) {
+    int workers_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if( workers_num > ANALYZE_MAX_WORKERS ) {
+        workers_num = ANALYZE_MAX_WORKERS;
+    }
+    if( workers_num > funcs->len / ANALYZE_MIN_CHUNK_FUNCS ) {
+        workers_num = funcs->len / ANALYZE_MIN_CHUNK_FUNCS;
+    }
+    if( workers_num < 2 ) {
+        for( int i = 0; i < funcs->len; i++ ) {
+            analyze_func_body(funcs->items[i]);
         }
+        return;
+    }
+
+    Stack         globals   = anlz.declared_vars;
+    uint32_t      next_func = 0;
+    AnalyzeError  error     = { .lock = PTHREAD_MUTEX_INITIALIZER, .func = UINT32_MAX };
+    AnalyzeWorker workers[ANALYZE_MAX_WORKERS];
+    pthread_t     threads[ANALYZE_MAX_WORKERS];
+    for( int i = 0; i < workers_num; i++ ) {
+        workers[i] = (AnalyzeWorker){ .funcs = funcs, .next_func = &next_func, .globals = &globals, .arena = Arena_new(), .error = &error };
+    }
+    for( int i = 1; i < workers_num; i++ ) {
+        if( pthread_create(&threads[i],NULL,analyze_worker,&workers[i]) != 0 ) {
+            PANIC("%s %d: Failed to create analyzer thread",__FILE__,__LINE__);
+        }
+    }
+    analyze_worker(&workers[0]);
+    for( int i = 1; i < workers_num; i++ ) {
+        pthread_join(threads[i],NULL);
+    }
+    if( error.func != UINT32_MAX ) {
+        printf("%s",error.message);
+        exit(-1);
+    }
+
+    anlz.declared_vars = globals;
+    for( int i = 0; i < workers_num; i++ ) {
+        Arena_merge(Ast_program_arena(funcs->items[0]),&workers[i].arena);
     }
 }
 
 void analyze_program_ast(AstExpr* ast) {
     Analyzer_init();
-    analyze_statements(ast);
+    FuncList funcs = { .items = NULL, .len = 0, .cap = 0 };
+    analyze_global_items(ast,GLOBAL_PASS_STRUCTS,&funcs);
+    analyze_global_items(ast,GLOBAL_PASS_FUNCS,&funcs);
+    analyze_global_items(ast,GLOBAL_PASS_REST,&funcs);
+    analyze_func_bodies(&funcs);
+    free(funcs.items);
     printf("\e[0;32manalyzed ✓\e[0m\n"); 
 }
 
-// 0 - OK, 1 - arr len not specified, 2 - arr len not specified in depth
-int analyze_type(Type* type) {
-    int err = 0;
+// interns a type tree from the parser bottom up
+static TypeId intern_parsed_type(Type* type) {
+    if( type->id != TYPE_NONE ) {
+        return type->id;
+    }
+    TypeId id;
+    switch( type->type_kind ) {
+        case UNKNOWN_TYPE:
+            id = Type_find_named(type->type_name);
+            ASSERT( ( id != TYPE_NONE ), "%s %d: Type not found {%s}",__FILE__,__LINE__,type->type_name);
+            return id;
+        case POINTER_TYPE:
+            return Type_pointer_to(intern_parsed_type(type->pointer_type.sub_type));
+        case ARRAY_TYPE:
+            return Type_array_of(intern_parsed_type(type->array_type.sub_type),type->array_type.length);
+        default:
+            PANIC("%s %d:PANICKED",__FILE__,__LINE__);
+    }
+}
+
+// *err: 0 - OK, 1 - arr len not specified, 2 - arr len not specified in depth
+TypeId analyze_type(Type* type, int* err) {
+    Type* root = type;
+    *err = 0;
     int was_previous_type_arr = 0;
     int depth = 0;
-    while( type->type_kind != UNKNOWN_TYPE ) {
+    while( type->type_kind == ARRAY_TYPE || type->type_kind == POINTER_TYPE ) {
         switch( type->type_kind ) {
             case ARRAY_TYPE:
                 if(was_previous_type_arr) {
@@ -754,9 +1019,9 @@ int analyze_type(Type* type) {
 
                 if( type->array_type.length == -1) {
                     if( depth == 0) {
-                        err = 1;
+                        *err = 1;
                     } else {
-                        err = 2;
+                        *err = 2;
                     }
                 }
 
@@ -766,13 +1031,8 @@ int analyze_type(Type* type) {
                 was_previous_type_arr = false;
                 type = type->pointer_type.sub_type;
                 break;
-            default:
-                PANIC("%s %d:PANICKED",__FILE__,__LINE__);
         }
         depth++;
     }
-    char* type_name = type->type_name;
-    *type = Analyzer_get_type(type_name,&get_type_err); 
-      ASSERT( ( get_type_err == 0 ), "%s %d: Type not found {%s}",__FILE__,__LINE__,type_name);
-    return err;
+    return intern_parsed_type(root);
 }
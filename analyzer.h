@@ -1,50 +1,69 @@
 #ifndef ANALYZER_H
 #define ANALYZER_H
 
-#define FRAMES_NUM 1000
-#define VARS_NUM   1000
-#define TYPES_NUM  1000
-
 #include <stdint.h>
 #include "parser.h"
 #include "types.h"
 
 typedef struct Variable {
     char* ident;
-    Type type;
+    TypeId type;
+    int shadowed; // index of the outer var with the same ident, -1 if none
+    Binding binding;
 } Variable;
 
+// ident -> innermost visible var, idents are interned so the pointer is the key.
+// Slots are never removed, top is -1 while no var with the ident is visible.
+typedef struct StackSlot {
+    char* ident; // NULL = empty slot
+    int   top;   // index into Stack.vars
+} StackSlot;
+
+// Scoped symbol table, vars are kept in declaration order and popping a frame
+// only touches the vars declared in it
 typedef struct Stack {
-    int       frames[FRAMES_NUM];
-    int       frames_idx;
-    Variable  vars[VARS_NUM];
-    int       pointer;
+    Variable*  vars;
+    int        pointer;    // number of vars
+    int        vars_cap;
+    int*       frames;     // index of the first var of every frame
+    int        frames_idx; // number of frames, 1 = global scope
+    int        frames_cap;
+    StackSlot* slots;
+    int        slots_cap;  // power of 2
+    int        slots_used;
 } Stack;
 
 typedef struct Analyzer {
     Stack declared_vars;
-    Type  types[TYPES_NUM];
-    int   types_idx;
+    int      func_frame;    // index of the first var of the current function, locals are numbered from it
+    uint32_t globals_num;
+    uint32_t functions_num;
 } Analyzer;
 
 
 void Analyzer_init();
-void Analyzer_append_type(Type type);
-Type Analyzer_get_type(char* type_name,int* err);
 
 Stack Stack_new();
 void Stack_new_frame(Stack* stk);
 void Stack_pop_frame(Stack* stk);
 void Stack_append(Stack* stk, Variable var);
+int Stack_find(Stack* stk, char* ident);
+Variable Stack_get(Stack* stk, char* ident);
+int Stack_find_curr_frame(Stack* stk, char* ident);
+void Stack_free(Stack* stk);
+Stack Stack_copy(Stack* stk);
+void analyze_statement(AstExpr* stm);
 void analyze_statements(AstExpr* stm);
+void analyze_func_sig(AstExpr* stm);
+void analyze_func_body(AstExpr* stm);
 void analyze_program_ast(AstExpr* ast);
-Type analyze_expr_statement_inner(AstExpr* stm);
-Type analyze_expr_statement(AstExpr* stm);
-Type analyze_func_call(AstExpr* stm);
+TypeId analyze_expr_statement_inner(AstExpr* stm);
+TypeId analyze_expr_statement(AstExpr* stm);
+TypeId analyze_func_call(AstExpr* stm);
 void analyze_func_call_args(AstExpr* stm);
 int type_is_impl(const char* type, ...);
 Type create_type_from_ast_node(AstExpr* node); // Depricated
-int analyze_type(Type* type);
+TypeId analyze_type(Type* type, int* err);
 const char* format_ast_type(AstExpr* stm);
 
 #define type_is(...) type_is_impl(__VA_ARGS__,NULL)
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define PANIC(fmt, ...) { \
+    printf(fmt "\n", ##__VA_ARGS__); \
+    exit(-1); \
+}
+
+#define ARENA_ALIGN 16
+
+Arena Arena_new() {
+    return (Arena){ .blocks = NULL, .allocated = 0 };
+}
+
+static ArenaBlock* arena_new_block(size_t size, ArenaBlock* next) {
+    ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+    if( block == NULL ) {
+        PANIC("%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    }
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void* Arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock* block = arena->blocks;
+    if( block == NULL || block->size - block->used < size ) {
+        if( size > ARENA_BLOCK_SIZE / 4 ) {
+            // big allocations get their own block behind the current one
+            // so the rest of the current block isnt wasted
+            ArenaBlock* big = arena_new_block(size,NULL);
+            if( block == NULL ) {
+                arena->blocks = big;
+            } else {
+                big->next = block->next;
+                block->next = big;
+            }
+            block = big;
+        } else {
+            block = arena_new_block(ARENA_BLOCK_SIZE,block);
+            arena->blocks = block;
+        }
+    }
+    void* ptr = block->data + block->used;
+    block->used += size;
+    arena->allocated += size;
+    memset(ptr,0,size);
+    return ptr;
+}
+
+// moves the blocks of src into dst, src is empty afterwards
+void Arena_merge(Arena* dst, Arena* src) {
+    if( src->blocks == NULL ) {
+        return;
+    }
+    if( dst->blocks == NULL ) {
+        dst->blocks = src->blocks;
+    } else {
+        // keep the current block of dst first so it keeps filling up
+        ArenaBlock* last = src->blocks;
+        while( last->next != NULL ) {
+            last = last->next;
+        }
+        last->next = dst->blocks->next;
+        dst->blocks->next = src->blocks;
+    }
+    dst->allocated += src->allocated;
+    src->blocks = NULL;
+    src->allocated = 0;
+}
+
+void Arena_free(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while( block != NULL ) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+    arena->allocated = 0;
+}
+
+// bytes taken from malloc including unused tails of blocks
+size_t Arena_reserved(Arena* arena) {
+    size_t reserved = 0;
+    for( ArenaBlock* block = arena->blocks; block != NULL; block = block->next ) {
+        reserved += sizeof(ArenaBlock) + block->size;
+    }
+    return reserved;
+}
@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+//Arena
+// Bump allocator, everything allocated from an arena is released at once
+// with Arena_free. Allocations are zeroed.
+
+#define ARENA_BLOCK_SIZE (64*1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    _Alignas(16) char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock* blocks;     // current block first
+    size_t      allocated;  // bytes handed out
+} Arena;
+
+Arena Arena_new();
+void* Arena_alloc(Arena* arena, size_t size);
+void Arena_merge(Arena* dst, Arena* src);
+void Arena_free(Arena* arena);
+size_t Arena_reserved(Arena* arena);
+
+#endif
@@ -0,0 +1,288 @@
+#include "artifact_cache.h"
+#include "my_string.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define ASSERT(expr, fmt, ...) { \
+    if (!expr) { \
+        printf(fmt "\n", ##__VA_ARGS__); \
+        exit(-1); \
+    } \
+}
+
+#define PANIC(fmt, ...) { \
+    printf(fmt "\n", ##__VA_ARGS__); \
+    exit(-1); \
+}
+
+#define ARTIFACT_STATS_FILE ARTIFACT_CACHE_DIR "/stats"
+
+extern char** environ;
+
+int ARTIFACT_CACHE = 0;
+
+char*    GCC_VERSION     = NULL; // output of gcc --version, part of every key
+size_t   GCC_VERSION_LEN = 0;
+
+uint32_t ARTIFACT_HITS   = 0;
+uint32_t ARTIFACT_MISSES = 0;
+
+// FNV-1a 128, 64 bits would be too few for telling builds apart by key alone
+static ArtifactKey hash_bytes(ArtifactKey key, const void* data, size_t len) {
+    const unsigned __int128 prime = ((unsigned __int128)1 << 88) | 0x13B;
+    unsigned __int128 h = ((unsigned __int128)key.hi << 64) | key.lo;
+    const unsigned char* p = (const unsigned char*)data;
+    for( size_t i = 0; i < len; i++ ) {
+        h ^= p[i];
+        h *= prime;
+    }
+    return (ArtifactKey){ .hi = (uint64_t)(h >> 64), .lo = (uint64_t)h };
+}
+
+static void key_path(ArtifactKey key, char* path, size_t path_size) {
+    snprintf(path,path_size,"%s/%016llx%016llx",ARTIFACT_CACHE_DIR,(unsigned long long)key.hi,(unsigned long long)key.lo);
+}
+
+// copies src to dest through a temporary file next to it so dest is never
+// half written, keeps the mode. Every copy has its own temporary, compiler
+// runs storing or fetching the same artifact at once dont write into each other
+static int copy_file(const char* src, const char* dest) {
+    int in = open(src, O_RDONLY);
+    if( in < 0 ) {
+        return 0;
+    }
+    struct stat st;
+    if( fstat(in,&st) != 0 ) {
+        close(in);
+        return 0;
+    }
+    char tmp[512];
+    snprintf(tmp,sizeof(tmp),"%s.tmp.XXXXXX",dest);
+    int out = mkstemp(tmp);
+    if( out < 0 ) {
+        close(in);
+        return 0;
+    }
+    fchmod(out,st.st_mode & 0777);
+    char buffer[64*1024];
+    int ok = 1;
+    while( ok ) {
+        ssize_t n = read(in,buffer,sizeof(buffer));
+        if( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( n <= 0 ) {
+            ok = n == 0;
+            break;
+        }
+        for( ssize_t done = 0; done < n; ) {
+            ssize_t w = write(out,buffer + done,n - done);
+            if( w < 0 && errno == EINTR ) {
+                continue;
+            }
+            if( w < 0 ) {
+                ok = 0;
+                break;
+            }
+            done += w;
+        }
+    }
+    close(in);
+    close(out);
+    if( !ok || rename(tmp,dest) != 0 ) {
+        unlink(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+// Enables the cache. gcc --version is read once, a different compiler
+// makes every key different
+void ArtifactCache_init() {
+    ARTIFACT_CACHE = 1;
+    mkdir("out", 0777);
+    mkdir("out/cache", 0777);
+    mkdir(ARTIFACT_CACHE_DIR, 0777);
+
+    int pipe_fds[2];
+    if( pipe(pipe_fds) != 0 ) {
+        PANIC("pipe failed: %s",strerror(errno));
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions,pipe_fds[1],STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions,pipe_fds[0]);
+    posix_spawn_file_actions_addclose(&actions,pipe_fds[1]);
+    char* argv[] = { "gcc", "--version", NULL };
+    pid_t pid;
+    int err = posix_spawnp(&pid,"gcc",&actions,NULL,argv,environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    if( err != 0 ) {
+        PANIC("Failed to start gcc: %s",strerror(err));
+    }
+
+    StringBuilder version = sb_new();
+    char buffer[4096];
+    ssize_t n;
+    while( (n = read(pipe_fds[0],buffer,sizeof(buffer))) != 0 ) {
+        if( n < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            break;
+        }
+        sb_append_n(&version,buffer,n);
+    }
+    close(pipe_fds[0]);
+    int status;
+    while( waitpid(pid,&status,0) < 0 && errno == EINTR ) {}
+    GCC_VERSION     = version.buffer;
+    GCC_VERSION_LEN = version.length;
+}
+
+// key of running gcc with flags (NULL terminated), inputs are added to it
+// with ArtifactCache_add/add_file. Paths dont belong in it, only contents
+ArtifactKey ArtifactCache_key(char** flags) {
+    ArtifactKey key = { .hi = 0x6c62272e07bb0142ull, .lo = 0x62b821756295c58dull };
+    key = hash_bytes(key,GCC_VERSION,GCC_VERSION_LEN);
+    for( char** flag = flags; *flag != NULL; flag++ ) {
+        key = hash_bytes(key,*flag,strlen(*flag) + 1); // with the '\0' so "-O","2" isnt "-O2"
+    }
+    return key;
+}
+
+ArtifactKey ArtifactCache_add(ArtifactKey key, const void* data, size_t len) {
+    key = hash_bytes(key,&len,sizeof(len));
+    return hash_bytes(key,data,len);
+}
+
+ArtifactKey ArtifactCache_add_file(ArtifactKey key, const char* path) {
+    String file = String_mapfile(path);
+    key = ArtifactCache_add(key,file.data,file.len);
+    String_unmap(&file);
+    return key;
+}
+
+// Copies the artifact of key to dest, 0 if it isnt cached
+int ArtifactCache_fetch(ArtifactKey key, const char* dest) {
+    char path[256];
+    key_path(key,path,sizeof(path));
+    if( copy_file(path,dest) ) {
+        utimensat(AT_FDCWD,path,NULL,0); // mtime is the last use, see ArtifactCache_finish
+        ARTIFACT_HITS++;
+        return 1;
+    }
+    ARTIFACT_MISSES++;
+    return 0;
+}
+
+// src is what gcc produced for key
+void ArtifactCache_store(ArtifactKey key, const char* src) {
+    char path[256];
+    key_path(key,path,sizeof(path));
+    if( !copy_file(src,path) ) {
+        printf("artifact cache: failed to store %s\n",src);
+    }
+}
+
+typedef struct ArtifactFile {
+    char   name[40];
+    time_t used;
+    off_t  size;
+} ArtifactFile;
+
+static int artifact_older(const void* a, const void* b) {
+    time_t x = ((const ArtifactFile*)a)->used;
+    time_t y = ((const ArtifactFile*)b)->used;
+    return (x > y) - (x < y);
+}
+
+// Removes the least recently used artifacts until the cache fits in
+// ARTIFACT_CACHE_MAX_SIZE and prints the hits and misses of this run and of all runs
+void ArtifactCache_finish() {
+    if( !ARTIFACT_CACHE ) {
+        return;
+    }
+    DIR* dir = opendir(ARTIFACT_CACHE_DIR);
+    if( dir == NULL ) {
+        return;
+    }
+    ArtifactFile* files = NULL;
+    size_t files_len = 0;
+    size_t files_cap = 0;
+    uint64_t total = 0;
+    struct dirent* entry;
+    while( (entry = readdir(dir)) != NULL ) {
+        if( strlen(entry->d_name) != 32 ) {
+            continue; // ".", "..", stats and unfinished .tmp copies
+        }
+        char path[sizeof(ARTIFACT_CACHE_DIR) + 33]; // "/" and the 32 char key, the '\0' is in the sizeof
+        if( snprintf(path,sizeof(path),"%s/%s",ARTIFACT_CACHE_DIR,entry->d_name) >= (int)sizeof(path) ) {
+            continue;
+        }
+        struct stat st;
+        if( stat(path,&st) != 0 ) {
+            continue;
+        }
+        if( files_len == files_cap ) {
+            files_cap = files_cap == 0 ? 64 : files_cap * 2;
+            files = (ArtifactFile*)realloc(files,sizeof(ArtifactFile) * files_cap);
+            ASSERT( (files != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+        }
+        ArtifactFile* file = &files[files_len++];
+        memcpy(file->name,entry->d_name,33);
+        file->used = st.st_mtime;
+        file->size = st.st_size;
+        total += st.st_size;
+    }
+    closedir(dir);
+
+    uint32_t evicted = 0;
+    if( total > ARTIFACT_CACHE_MAX_SIZE ) {
+        qsort(files,files_len,sizeof(ArtifactFile),artifact_older);
+        for( size_t i = 0; i < files_len && total > ARTIFACT_CACHE_MAX_SIZE; i++ ) {
+            char path[256];
+            snprintf(path,sizeof(path),"%s/%s",ARTIFACT_CACHE_DIR,files[i].name);
+            if( unlink(path) == 0 ) {
+                total -= files[i].size;
+                evicted++;
+            }
+        }
+    }
+    free(files);
+
+    // stats file: "<hits> <misses>" of every run so far
+    unsigned long long all_hits = 0;
+    unsigned long long all_misses = 0;
+    FILE* stats = fopen(ARTIFACT_STATS_FILE,"r");
+    if( stats != NULL ) {
+        if( fscanf(stats,"%llu %llu",&all_hits,&all_misses) != 2 ) {
+            all_hits = all_misses = 0;
+        }
+        fclose(stats);
+    }
+    all_hits   += ARTIFACT_HITS;
+    all_misses += ARTIFACT_MISSES;
+    stats = fopen(ARTIFACT_STATS_FILE,"w");
+    if( stats != NULL ) {
+        fprintf(stats,"%llu %llu\n",all_hits,all_misses);
+        fclose(stats);
+    }
+    printf("artifact cache: %u hits, %u misses, %llu hits and %llu misses in total, %zu artifacts, %llu KB",
+           ARTIFACT_HITS,ARTIFACT_MISSES,all_hits,all_misses,files_len - evicted,(unsigned long long)(total / 1024));
+    if( evicted > 0 ) {
+        printf(", %u evicted",evicted);
+    }
+    printf("\n");
+}
@@ -0,0 +1,31 @@
+#ifndef ARTIFACT_CACHE_H
+#define ARTIFACT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//ArtifactCache
+// Keeps what gcc produced (objects and executables) under a key hashed from
+// the gcc version, the flags and the input files, so compiling the same C
+// again is a copy. Enabled with --cache, the least recently used artifacts
+// are removed once the cache grows past ARTIFACT_CACHE_MAX_SIZE.
+
+#define ARTIFACT_CACHE_DIR      "out/cache/artifacts"
+#define ARTIFACT_CACHE_MAX_SIZE (512ull*1024*1024)
+
+typedef struct ArtifactKey {
+    uint64_t hi;
+    uint64_t lo;
+} ArtifactKey;
+
+extern int ARTIFACT_CACHE;
+
+void ArtifactCache_init();
+ArtifactKey ArtifactCache_key(char** flags);
+ArtifactKey ArtifactCache_add(ArtifactKey key, const void* data, size_t len);
+ArtifactKey ArtifactCache_add_file(ArtifactKey key, const char* path);
+int ArtifactCache_fetch(ArtifactKey key, const char* dest);
+void ArtifactCache_store(ArtifactKey key, const char* src);
+void ArtifactCache_finish();
+
+#endif
@@ -3,6 +3,8 @@
 #include "types.h"
 #include "my_string.h"
 #include "analyzer.h"
+#include "incremental.h"
+#include "artifact_cache.h"
 
 #define ASSERT(expr, fmt, ...) { \
     if (!expr) { \
@@ -16,14 +18,67 @@
     exit(-1); \
 }
 
-#define PADDING() { \
-    for(int n = 0; n < CURR_DEPTH; n++) { \
-        sb_append(sb,"    "); \
-    } \
-} \
+#define PADDING() generate_padding(sb)
 
 int CURR_DEPTH = 0;
 
+typedef struct BuildProfileInfo {
+    const char* name;
+    char*       gcc_flags[4]; // NULL terminated
+    uint8_t     static_funcs; // everything but main is static so gcc can inline and drop it
+    uint8_t     indent;
+} BuildProfileInfo;
+
+const BuildProfileInfo BUILD_PROFILES[PROFILE_COUNT] = {
+    [PROFILE_DEBUG]   = { "debug",   { "-O0", "-g", NULL },                  0, 1 },
+    [PROFILE_RELEASE] = { "release", { "-O2", NULL },                        1, 0 },
+    [PROFILE_NATIVE]  = { "native",  { "-O3", "-march=native", "-flto", NULL }, 1, 0 },
+};
+
+BuildProfile BUILD_PROFILE = PROFILE_DEBUG;
+
+// translation units the functions are split into, see compile_program_units
+int OUTPUT_UNITS = 1;
+
+// functions with at most this many tokens in their body are emitted static inline
+#define SMALL_FUNC_TOKENS 48
+
+// the output is flushed to its file between top level items once this much is buffered
+#define OUTPUT_FLUSH_SIZE (64*1024)
+
+// indentation is copied out of this instead of appended level by level
+#define PADDING_SPACES_LEN 128
+const char PADDING_SPACES[PADDING_SPACES_LEN + 1] =
+    "                                                                "
+    "                                                                ";
+
+// 0 if there is no profile called name
+int set_build_profile(const char* name) {
+    for( int i = 0; i < PROFILE_COUNT; i++ ) {
+        if( strcmp(BUILD_PROFILES[i].name,name) == 0 ) {
+            BUILD_PROFILE = (BuildProfile)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* build_profile_name() {
+    return BUILD_PROFILES[BUILD_PROFILE].name;
+}
+
+void generate_padding(StringBuilder* sb) {
+    if( !BUILD_PROFILES[BUILD_PROFILE].indent ) {
+        return;
+    }
+    size_t len = CURR_DEPTH > 0 ? CURR_DEPTH * 4 : 0;
+    while( len > PADDING_SPACES_LEN ) {
+        sb_append_n(sb,PADDING_SPACES,PADDING_SPACES_LEN);
+        len -= PADDING_SPACES_LEN;
+    }
+    sb_append_n(sb,PADDING_SPACES,len);
+}
+
 void generate_type(StringBuilder* sb, Type* type) {
     switch( type->type_kind ) {
         case STRUCT_TYPE:
@@ -31,16 +86,16 @@ void generate_type(StringBuilder* sb, Type* type) {
         case ENUM_TYPE:
         case UNION_TYPE:
             ASSERT( (type->type_name != NULL), "%s %d:PANICKED",__FILE__,__LINE__);
-            sb_append(sb,type->type_name);
+            sb_append_str(sb,type->type_name);
             break;
         case POINTER_TYPE:
             generate_type(sb,type->pointer_type.sub_type);
-            sb_append(sb,"*");
+            sb_append_char(sb,'*');
             break;
         case ARRAY_TYPE:
             //generate_type(sb,type->array_type.sub_type);
             //sb_append(sb,"__%s"); 
-            sb_append(sb,"__Array ");
+            sb_append_str(sb,"__Array ");
             break;
             //PANIC("%s %d:Arrays not supported",__FILE__,__LINE__);
             //sb_append(sb,"Intrinsics_Array");
@@ -51,15 +106,15 @@ void generate_type(StringBuilder* sb, Type* type) {
         case FUNCTION_TYPE:
         case UNKNOWN_TYPE:
         default:
-            sb_append(sb,type->type_name);
+            sb_append_str(sb,type->type_name);
             break;
             PANIC("%s %d:PANICKED",__FILE__,__LINE__);
     }
 }
 void generate_arg_decl(StringBuilder* sb,AstExpr* curr_stm) {
-    sb_append(sb,"(");
+    sb_append_char(sb,'(');
     if(curr_stm == NULL) {
-        sb_append(sb,")");
+        sb_append_char(sb,')');
         return;
     }
 
@@ -68,38 +123,65 @@ void generate_arg_decl(StringBuilder* sb,AstExpr* curr_stm) {
         char* curr_ident = curr_stm->argument_decl.ident;
 
         generate_type(sb,curr_type);
-        sb_append(sb," %s ",curr_ident);
+        sb_append_char(sb,' ');
+        sb_append_str(sb,curr_ident);
+        sb_append_char(sb,' ');
 
         curr_stm = curr_stm->argument_decl.next;
 
         if(curr_stm == NULL) {
             break;
         } else {
-            sb_append(sb,",");
+            sb_append_char(sb,',');
         }
     }
-    sb_append(sb,")");
+    sb_append_char(sb,')');
 }
 int _;
 
 void generate_block_statement(StringBuilder* sb, AstExpr* stm) {
     //PADDING();
-    sb_append(sb,"{\n");
+    sb_append_str(sb,"{\n");
     generate_statements(sb,stm->block_statement.statements);
     PADDING();
-    sb_append(sb,"}\n");
+    sb_append_str(sb,"}\n");
+}
+
+// the prototype and the definition have to agree
+void generate_func_specifiers(StringBuilder* sb, AstExpr* stm) {
+    // with several units any function can be called from another one
+    if( !BUILD_PROFILES[BUILD_PROFILE].static_funcs || OUTPUT_UNITS > 1 || strcmp(stm->function_declaration->name,"main") == 0 ) {
+        return;
+    }
+    AstExpr* body = stm->function_declaration->body;
+    if( body->lazy_block->end - body->lazy_block->start <= SMALL_FUNC_TOKENS ) {
+        sb_append_str(sb,"static inline ");
+    } else {
+        sb_append_str(sb,"static ");
+    }
 }
 
 void generate_func_decl(StringBuilder* sb, AstExpr* stm) {
-    generate_type(sb,stm->function_declaration.return_type);
-    sb_append(sb," ");
-    sb_append(sb,stm->function_declaration.name);
-    generate_arg_decl(sb,stm->function_declaration.args);
-    generate_block_statement(sb,stm->function_declaration.body);
+    if( !Ast_func_reached(stm) ) {
+        return;
+    }
+    if( Ast_func_cached(stm) ) {
+        const char* fragment = Incremental_fragment(stm);
+        sb_write_through(sb,fragment,strlen(fragment));
+        return;
+    }
+    size_t start = sb->length;
+    generate_func_specifiers(sb,stm);
+    generate_type(sb,stm->function_declaration->return_type);
+    sb_append_char(sb,' ');
+    sb_append_str(sb,stm->function_declaration->name);
+    generate_arg_decl(sb,stm->function_declaration->args);
+    generate_block_statement(sb,Ast_func_body(stm));
+    Incremental_store(stm,sb->buffer + start,sb->length - start);
 }
 void generate_func_call(StringBuilder* sb, AstExpr* stm) {
-    sb_append(sb,stm->func_call.identifier.value);
-    sb_append(sb,"(");
+    sb_append_str(sb,stm->func_call.name);
+    sb_append_char(sb,'(');
     AstExpr* curr_arg = stm->func_call.args;
     if( curr_arg != NULL) {
         while(1) {
@@ -108,16 +190,16 @@ void generate_func_call(StringBuilder* sb, AstExpr* stm) {
             if( curr_arg == NULL) {
                 break;
             }
-            sb_append(sb,",");
+            sb_append_char(sb,',');
         }
     }
-    sb_append(sb,")");
+    sb_append_char(sb,')');
 }
 void generate_expr(StringBuilder* sb, AstExpr* stm) {
     switch( stm->type ) {
         char* operator = "";
         case AST_UNARY_OPERATION:
-            switch( stm->unary_operation.opp_token.kind ) {
+            switch( stm->unary_operation.opp ) {
                 case NOT:           operator = "!"; break;
                 case MINUS:         operator = "-"; break;
                 case PLUS_PLUS:     operator = "++"; break;
@@ -127,13 +209,13 @@ void generate_expr(StringBuilder* sb, AstExpr* stm) {
                 default: 
                     PANIC("%s %d: Panicked",__FILE__,__LINE__);
             }
-            sb_append(sb,operator);
-            sb_append(sb,"(");
+            sb_append_str(sb,operator);
+            sb_append_char(sb,'(');
             generate_expr(sb,stm->unary_operation.right);
-            sb_append(sb,")");
+            sb_append_char(sb,')');
             break;
         case AST_BINARY_OPERATION:
-            switch( stm->binary_operation.opp_token.kind ) {
+            switch( stm->binary_operation.opp ) {
                 case STAR:              operator = "*"; break;
                 case PLUS:              operator = "+";break;
                 case DIVITION:          operator = "/";break;
@@ -152,36 +234,38 @@ void generate_expr(StringBuilder* sb, AstExpr* stm) {
                 default:
                     PANIC("%s %d:PANICKED",__FILE__,__LINE__);
             }
-            sb_append(sb,"(");
-            if(  stm->binary_operation.opp_token.kind == SUBSCRIPT_OPEN) {
-                sb_append(sb,"((");
-                generate_type(sb,&stm->binary_operation.type);
-                sb_append(sb,"*");
-                sb_append(sb,")");
+            sb_append_char(sb,'(');
+            if(  stm->binary_operation.opp == SUBSCRIPT_OPEN) {
+                sb_append_str(sb,"((");
+                generate_type(sb,Type_get(*Ast_type(stm)));
+                sb_append_char(sb,'*');
+                sb_append_char(sb,')');
             }
             generate_expr(sb,stm->binary_operation.left);
 
-            if(  stm->binary_operation.opp_token.kind == SUBSCRIPT_OPEN) {
-                sb_append(sb,".data");
+            if(  stm->binary_operation.opp == SUBSCRIPT_OPEN) {
+                sb_append_str(sb,".data");
             }
 
-            sb_append(sb," ");
-            sb_append(sb,operator);
-            sb_append(sb," ");
+            sb_append_char(sb,' ');
+            sb_append_str(sb,operator);
+            sb_append_char(sb,' ');
             generate_expr(sb,stm->binary_operation.right);
-            if(  stm->binary_operation.opp_token.kind == SUBSCRIPT_OPEN) {
-                sb_append(sb,"]");
+            if(  stm->binary_operation.opp == SUBSCRIPT_OPEN) {
+                sb_append_char(sb,']');
             }
-            sb_append(sb,")");
+            sb_append_char(sb,')');
             break;
         case AST_IDENTIFIER:
-            sb_append(sb,stm->identifier.token.value);
+            sb_append_n(sb,stm->identifier.token.value,stm->identifier.token.len);
             return;
         case AST_NUMBER:
-            sb_append(sb,stm->number.token.value);
+            sb_append_n(sb,stm->number.token.value,stm->number.token.len);
             return;
         case AST_STRING:
-            sb_append(sb,"\"%s\"",stm->string.token.value);
+            sb_append_char(sb,'"');
+            sb_append_n(sb,stm->string.token.value,stm->string.token.len);
+            sb_append_char(sb,'"');
             return;
         case AST_FUNC_CALL:
             return generate_func_call(sb,stm); 
@@ -197,67 +281,89 @@ void generate_expr_statement(StringBuilder* sb, AstExpr* stm) {
 
 void generate_decl(StringBuilder* sb, AstExpr* stm) {
     PADDING();
-    if( stm->declaration.type->type_kind == ARRAY_TYPE ) {
-        generate_type(sb,stm->declaration.type->array_type.sub_type);
-        if( stm->declaration.type->array_type.length == -1 ) {
+    if( stm->declaration->type->type_kind == ARRAY_TYPE ) {
+        generate_type(sb,stm->declaration->type->array_type.sub_type);
+        if( stm->declaration->type->array_type.length == -1 ) {
             // if len not specified there has to be an expr
-            int len = stm->declaration.value->expression_statement.type.array_type.length;
+            int len = Type_get(*Ast_type(stm->declaration->value))->array_type.length;
 
             sb_append(sb," __%s[%d]; __Array %s = (__Array){.data=__%s,.length=%d}",
-                      stm->declaration.name,
+                      stm->declaration->name,
                       len,
-                      stm->declaration.name,
-                      stm->declaration.name,
+                      stm->declaration->name,
+                      stm->declaration->name,
                       len
                       );
-            sb_append(sb,"; %s = ",stm->declaration.name);
-            generate_expr_statement(sb,stm->declaration.value);
+            sb_append_str(sb,"; ");
+            sb_append_str(sb,stm->declaration->name);
+            sb_append_str(sb," = ");
+            generate_expr_statement(sb,stm->declaration->value);
         } else {
             sb_append(sb," __%s[%d]; __Array %s = (__Array){.data=__%s,.length=%d}",
-                      stm->declaration.name,
-                      stm->declaration.type->array_type.length,
-                      stm->declaration.name,
-                      stm->declaration.name,
-                      stm->declaration.type->array_type.length
+                      stm->declaration->name,
+                      stm->declaration->type->array_type.length,
+                      stm->declaration->name,
+                      stm->declaration->name,
+                      stm->declaration->type->array_type.length
                       );
-            if( stm->declaration.value->expression_statement.value != NULL ) {
-                sb_append(sb,"; %s = ",stm->declaration.name);
-                generate_expr_statement(sb,stm->declaration.value);
+            if( stm->declaration->value->expression_statement.value != NULL ) {
+                sb_append_str(sb,"; ");
+                sb_append_str(sb,stm->declaration->name);
+                sb_append_str(sb," = ");
+                generate_expr_statement(sb,stm->declaration->value);
             }
         }
     } else {
-        generate_type(sb,stm->declaration.type);
-        sb_append(sb," %s",stm->declaration.name);
-        if( stm->declaration.value->expression_statement.value != NULL ) {
-            sb_append(sb," = ");
-            generate_expr_statement(sb,stm->declaration.value);
+        generate_type(sb,stm->declaration->type);
+        sb_append_char(sb,' ');
+        sb_append_str(sb,stm->declaration->name);
+        if( stm->declaration->value->expression_statement.value != NULL ) {
+            sb_append_str(sb," = ");
+            generate_expr_statement(sb,stm->declaration->value);
         }
     }
-    sb_append(sb,";\n");
+    sb_append_str(sb,";\n");
 }
 
 void generate_if(StringBuilder* sb, AstExpr* stm) {
     PADDING();
-    sb_append(sb,"if ");
+    sb_append_str(sb,"if ");
     generate_expr_statement(sb,stm->if_statement.condition);
-    sb_append(sb," ");
+    sb_append_char(sb,' ');
     generate_block_statement(sb,stm->if_statement.body); 
 }
+// fields come from the analyzed struct type, the static assert makes gcc
+// check it lays the struct out the same way Type_make_struct did
 void generate_struct_decl(StringBuilder* sb, AstExpr* stm) {
-    sb_append(sb,"typedef struct ");
-    generate_block_statement(sb,stm->struct_declaration.body); 
-    sb->length--; // delete the newline
-    sb_append(sb,"%s;\n",stm->struct_declaration.name);
+    Type* type = Type_get(Type_find_named(stm->struct_declaration.name));
+    sb_append_str(sb,"typedef struct {\n");
+    CURR_DEPTH += 1;
+    for( uint32_t n = 0; n < type->struct_type.fields_num; n++ ) {
+        StructField* field = &type->struct_type.fields[n];
+        Type* field_type = Type_get(field->type);
+        if( field_type->type_kind == ARRAY_TYPE ) {
+            PANIC("Array fields are not supported, struct {%s} field '%s'",type->type_name,field->name);
+        }
+        PADDING();
+        generate_type(sb,field_type);
+        sb_append(sb," %s;\n",field->name);
+    }
+    CURR_DEPTH -= 1;
+    sb_append(sb,"}%s;\n",type->type_name);
+    sb_append(sb,"_Static_assert(sizeof(%s) == %u, \"layout of %s\");\n",type->type_name,type->struct_type.size,type->type_name);
 }
 
 void generate_statements(StringBuilder* sb, AstExpr* stm) {
     CURR_DEPTH += 1;
     AstExpr* next = stm;
     while( next != NULL ) {
+        if( CURR_DEPTH == 0 && sb->length >= OUTPUT_FLUSH_SIZE ) {
+            sb_flush(sb); // top level, nothing points into the buffer
+        }
         switch( next->type ) {
             case AST_FUNCTION_DECLARATION:
                 generate_func_decl(sb,next); 
-                next = next->function_declaration.next;
+                next = next->function_declaration->next;
                 break;
             case AST_BLOCK_STATEMENT:
                 PADDING();
@@ -265,8 +371,10 @@ void generate_statements(StringBuilder* sb, AstExpr* stm) {
                 next = next->block_statement.next;
                 break;
             case AST_DECLARATION:
-                generate_decl(sb,next); 
-                next = next->declaration.next;
+                if( CURR_DEPTH > 0 ) { // globals are hoisted by generate_declarations
+                    generate_decl(sb,next); 
+                }
+                next = next->declaration->next;
                 break;
             case AST_IF_STATEMENT:
                 generate_if(sb,next); 
@@ -275,11 +383,11 @@ void generate_statements(StringBuilder* sb, AstExpr* stm) {
             case AST_EXPRESSION_STATEMENT:
                 PADDING();
                 generate_expr_statement(sb,next); 
-                sb_append(sb,";\n");
+                sb_append_str(sb,";\n");
                 next = next->expression_statement.next;
                 break;
             case AST_STRUCT_DECLARATION:    
-                generate_struct_decl(sb,next);
+                // hoisted by generate_declarations
                 next = next->struct_declaration.next;
                 break;
             case AST_EXTERN_STATEMENT:    
@@ -289,7 +397,7 @@ void generate_statements(StringBuilder* sb, AstExpr* stm) {
             /*
             case AST_FOR_STATEMENT:
                 analyze_for(next); 
-                next = next->for_statement.next;
+                next = next->for_statement->next;
                 break;
             case AST_WHILE_STATEMENT:
                 analyze_while(next); 
@@ -307,42 +415,132 @@ void generate_statements(StringBuilder* sb, AstExpr* stm) {
     CURR_DEPTH -= 1;
 }
 
+void generate_func_proto(StringBuilder* sb, AstExpr* stm) {
+    if( !Ast_func_reached(stm) ) {
+        return;
+    }
+    generate_func_specifiers(sb,stm);
+    generate_type(sb,stm->function_declaration->return_type);
+    sb_append_char(sb,' ');
+    sb_append_str(sb,stm->function_declaration->name);
+    generate_arg_decl(sb,stm->function_declaration->args);
+    sb_append_str(sb,";\n");
+}
+
+// only the name, the initializer runs in the unit that defines the global
+void generate_extern_decl(StringBuilder* sb, AstExpr* stm) {
+    sb_append_str(sb,"extern ");
+    if( stm->declaration->type->type_kind == ARRAY_TYPE ) {
+        sb_append_str(sb,"__Array ");
+    } else {
+        generate_type(sb,stm->declaration->type);
+        sb_append_char(sb,' ');
+    }
+    sb_append_str(sb,stm->declaration->name);
+    sb_append_str(sb,";\n");
+}
+
+// The analyzer lets the top level be used before it is declared, C doesnt,
+// so structs, globals and function prototypes go first. With extern_globals
+// the globals are only declared, for the header shared by the units
+void generate_declarations(StringBuilder* sb, AstExpr* program, int extern_globals) {
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_STRUCT_DECLARATION ) {
+            generate_struct_decl(sb,stm);
+        }
+    }
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_DECLARATION ) {
+            if( extern_globals ) {
+                generate_extern_decl(sb,stm);
+            } else {
+                generate_decl(sb,stm);
+            }
+        }
+    }
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_FUNCTION_DECLARATION ) {
+            generate_func_proto(sb,stm);
+        }
+        if( sb->length >= OUTPUT_FLUSH_SIZE ) {
+            sb_flush(sb);
+        }
+    }
+}
 
-char* generate_output(AstExpr* node) {
-    StringBuilder output_sb = sb_new();
-    const char *header = 
-        "#include <stdio.h>\n"
-        "#include <stdlib.h>\n"
-        "typedef struct {\n"
-        "   void* data;\n"
-        "   int length;\n"
-        "} __Array;\n"
-        "// ===================== end of HEADER =================================\n"
-    ;
+// Streams the C program to fd. Only the top level item being generated is
+// kept in memory, cached functions and the header arent copied at all.
+// returns the number of bytes written
+const char OUTPUT_HEADER[] =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "typedef struct {\n"
+    "   void* data;\n"
+    "   int length;\n"
+    "} __Array;\n"
+    "// ===================== end of HEADER =================================\n"
+;
 
-    sb_append(&output_sb,header);
+size_t generate_output(AstExpr* node, int fd) {
+    StringBuilder output_sb = sb_new_fd(fd,OUTPUT_FLUSH_SIZE*2);
+
+    sb_write_through(&output_sb,OUTPUT_HEADER,sizeof(OUTPUT_HEADER)-1);
+    CURR_DEPTH = 0;
+    generate_declarations(&output_sb,node,0);
     CURR_DEPTH = -1;
     generate_statements(&output_sb,node);
 
-    return output_sb.buffer;
+    sb_flush(&output_sb);
+    sb_free(&output_sb);
+    return output_sb.written;
 }
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
 
-int compile_string(char* source) {
-    mkdir("out", 0777);
-    const char *filename = "out/out.c";
-    FILE *file = fopen(filename, "w");
-    if (file == NULL) { PANIC("Failed to create temporary file"); }
+extern char** environ;
 
-    // Write the C code to the file
-    fprintf(file, "%s", source);
-    fclose(file);
+// argv[0] is started directly, without a shell. stdin_fd becomes its stdin, -1 keeps ours
+pid_t spawn_process(char** argv, int stdin_fd, int close_fd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if( stdin_fd >= 0 ) {
+        posix_spawn_file_actions_adddup2(&actions,stdin_fd,STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions,stdin_fd);
+    }
+    if( close_fd >= 0 ) {
+        posix_spawn_file_actions_addclose(&actions,close_fd);
+    }
+    pid_t pid;
+    int err = posix_spawnp(&pid,argv[0],&actions,NULL,argv,environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if( err != 0 ) {
+        PANIC("Failed to start %s: %s",argv[0],strerror(err));
+    }
+    return pid;
+}
+
+// raw waitpid status
+int wait_process(pid_t pid) {
+    int status;
+    while( waitpid(pid,&status,0) < 0 ) {
+        if( errno != EINTR ) {
+            PANIC("waitpid failed: %s",strerror(errno));
+        }
+    }
+    return status;
+}
 
-    // Compile the temporary file
-    int compile_status = system("cd ./out; gcc -g out.c -o out");
-    if (compile_status != 0) {
+static int wait_gcc(pid_t pid) {
+    int status = wait_process(pid);
+    if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
         PANIC("Compilation failed\n");
         return 1;
     } else {
@@ -350,3 +548,335 @@ int compile_string(char* source) {
         return 0;
     }
 }
+
+// Writes the C program to OUTPUT_FILE, returns its size
+size_t write_output(AstExpr* node) {
+    mkdir(OUTPUT_DIR, 0777);
+    int fd = open(OUTPUT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) { PANIC("Failed to create %s",OUTPUT_FILE); }
+    size_t size = generate_output(node,fd);
+    close(fd);
+    return size;
+}
+
+// gcc, the flags of BUILD_PROFILE and extra_flags (NULL terminated, can be NULL).
+// Returns argc, the caller adds the inputs, the output and the NULL
+static int gcc_argv(char** argv, char** extra_flags) {
+    int argc = 0;
+    argv[argc++] = "gcc";
+    for( char* const* flag = BUILD_PROFILES[BUILD_PROFILE].gcc_flags; *flag != NULL; flag++ ) {
+        argv[argc++] = *flag;
+    }
+    for( char** flag = extra_flags; flag != NULL && *flag != NULL; flag++ ) {
+        argv[argc++] = *flag;
+    }
+    return argc;
+}
+
+// gcc_argv for compiling input (a file or "-" for stdin) to out
+static void gcc_argv_compile(char** argv, char* input, char* out, char** extra_flags) {
+    int argc = gcc_argv(argv,extra_flags);
+    if( strcmp(input,"-") == 0 ) {
+        argv[argc++] = "-x";
+        argv[argc++] = "c";
+    }
+    argv[argc++] = input;
+    argv[argc++] = "-o";
+    argv[argc++] = out;
+    argv[argc++] = NULL;
+}
+
+// artifact cache key of gcc with the flags gcc_argv gives, without inputs yet
+static ArtifactKey gcc_artifact_key(char** extra_flags) {
+    char* argv[24];
+    int argc = gcc_argv(argv,extra_flags);
+    argv[argc] = NULL;
+    return ArtifactCache_key(argv + 1);
+}
+
+// compiles OUTPUT_FILE written by write_output
+int compile_output() {
+    ArtifactKey key;
+    if( ARTIFACT_CACHE ) {
+        key = ArtifactCache_add_file(gcc_artifact_key(NULL),OUTPUT_FILE);
+        if( ArtifactCache_fetch(key,OUTPUT_BINARY) ) {
+            printf("\e[0;32mCompiled ✓\e[0m (cached)\n");
+            return 0;
+        }
+    }
+    char* argv[24];
+    gcc_argv_compile(argv,OUTPUT_FILE,OUTPUT_BINARY,NULL);
+    int result = wait_gcc(spawn_process(argv,-1,-1));
+    if( ARTIFACT_CACHE ) {
+        ArtifactCache_store(key,OUTPUT_BINARY);
+    }
+    return result;
+}
+
+// the profile directory of OUTPUT_FILE trained with train_cmd: a different
+// program, build profile or training gets its own
+static void pgo_dir(char* dir, size_t dir_size, const char* train_cmd) {
+    String c = String_mapfile(OUTPUT_FILE);
+    const char* profile = build_profile_name();
+    uint64_t hash = FNV1A_INIT;
+    hash = Hash_fnv1a(hash,profile,strlen(profile) + 1);
+    hash = Hash_fnv1a(hash,train_cmd,strlen(train_cmd) + 1);
+    hash = Hash_fnv1a(hash,c.data,c.len);
+    String_unmap(&c);
+    snprintf(dir,dir_size,"%s/%016llx",PGO_DIR,(unsigned long long)hash);
+}
+
+// the .gcda gcc reads for OUTPUT_BINARY. gcc names it after the absolute
+// path of the object with '/' replaced by '#', -fprofile-prefix-path strips
+// the working directory from it so the profile still fits after the project moved
+static void pgo_profile_file(char* path, size_t path_size, const char* dir) {
+    char name[] = OUTPUT_BINARY;
+    for( char* c = name; *c; c++ ) {
+        if( *c == '/' ) {
+            *c = '#';
+        }
+    }
+    int len = snprintf(path,path_size,"%s/%s.gcda",dir,name);
+    if( len < 0 || (size_t)len >= path_size ) {
+        PANIC("pgo: profile path too long: %s/%s.gcda",dir,name);
+    }
+}
+
+// Profile guided build of OUTPUT_FILE: builds it with -fprofile-generate,
+// runs train_cmd (through sh, it usually runs OUTPUT_BINARY with some input)
+// and rebuilds with the collected profile. The profile is kept per program
+// in PGO_DIR so rebuilding an unchanged program skips the first two steps.
+int compile_output_pgo(const char* train_cmd) {
+    char dir[256];
+    char profile_file[512];
+    pgo_dir(dir,sizeof(dir),train_cmd);
+    pgo_profile_file(profile_file,sizeof(profile_file),dir);
+    char cwd[PATH_MAX];
+    if( getcwd(cwd,sizeof(cwd)) == NULL ) {
+        PANIC("pgo: getcwd failed: %s",strerror(errno));
+    }
+    char generate_flag[300];
+    char use_flag[300];
+    char prefix_flag[PATH_MAX + 32];
+    snprintf(generate_flag,sizeof(generate_flag),"-fprofile-generate=%s",dir);
+    snprintf(use_flag,sizeof(use_flag),"-fprofile-use=%s",dir);
+    snprintf(prefix_flag,sizeof(prefix_flag),"-fprofile-prefix-path=%s",cwd);
+
+    char* argv[24];
+    if( access(profile_file,R_OK) == 0 ) {
+        printf("pgo: reusing the profile %s\n",profile_file);
+    } else {
+        mkdir(PGO_DIR, 0777);
+        mkdir(dir, 0777);
+        char* generate_flags[] = { generate_flag, prefix_flag, NULL };
+        gcc_argv_compile(argv,OUTPUT_FILE,OUTPUT_BINARY,generate_flags);
+        wait_gcc(spawn_process(argv,-1,-1));
+
+        printf("pgo: training with: %s\n",train_cmd);
+        char* train_argv[] = { "/bin/sh", "-c", (char*)train_cmd, NULL };
+        int status = wait_process(spawn_process(train_argv,-1,-1));
+        if( WIFEXITED(status) && WEXITSTATUS(status) == 127 ) {
+            PANIC("pgo: training command not found: %s",train_cmd);
+        }
+        if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+            // programs can exit with anything, the profile is still written unless it crashed
+            printf("pgo: training command exited with status %d\n",WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        }
+        if( access(profile_file,R_OK) != 0 ) {
+            printf("pgo: training produced no profile %s, building without it\n",profile_file);
+        }
+    }
+    // partial training: code the training didnt reach is optimized normally instead of for size
+    char* use_flags[] = { use_flag, prefix_flag, "-fprofile-partial-training", NULL };
+    gcc_argv_compile(argv,OUTPUT_FILE,OUTPUT_BINARY,use_flags);
+    return wait_gcc(spawn_process(argv,-1,-1));
+}
+
+// Generates the C program straight into gcc's stdin, gcc parses it while
+// the backend is still generating. Nothing is written to disk but the binary.
+int compile_program(AstExpr* node, size_t* output_len) {
+    mkdir(OUTPUT_DIR, 0777);
+    int pipe_fds[2];
+    if( pipe(pipe_fds) != 0 ) {
+        PANIC("pipe failed: %s",strerror(errno));
+    }
+    char* argv[24];
+    gcc_argv_compile(argv,"-",OUTPUT_BINARY,NULL);
+    pid_t pid = spawn_process(argv,pipe_fds[0],pipe_fds[1]);
+    close(pipe_fds[0]);
+
+    // if gcc exits early the write fails and is reported instead of killing us
+    signal(SIGPIPE,SIG_IGN);
+    *output_len = generate_output(node,pipe_fds[1]);
+    close(pipe_fds[1]);
+    return wait_gcc(pid);
+}
+
+// Writes OUTPUT_UNITS_DIR/decls.h, the header, structs, extern globals and
+// prototypes. Every unit includes it
+static size_t write_units_header(AstExpr* program) {
+    int fd = open(OUTPUT_UNITS_DIR "/decls.h", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) { PANIC("Failed to create %s",OUTPUT_UNITS_DIR "/decls.h"); }
+    StringBuilder sb = sb_new_fd(fd,OUTPUT_FLUSH_SIZE*2);
+    sb_write_through(&sb,OUTPUT_HEADER,sizeof(OUTPUT_HEADER)-1);
+    CURR_DEPTH = 0;
+    generate_declarations(&sb,program,1);
+    sb_flush(&sb);
+    sb_free(&sb);
+    close(fd);
+    return sb.written;
+}
+
+// Writes OUTPUT_UNITS_DIR/u<unit>.c with the functions funcs[start..end),
+// unit 0 also defines the globals
+static size_t write_unit(AstExpr* program, int unit, AstExpr** funcs, int start, int end) {
+    char path[64];
+    snprintf(path,sizeof(path),"%s/u%d.c",OUTPUT_UNITS_DIR,unit);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) { PANIC("Failed to create %s",path); }
+    StringBuilder sb = sb_new_fd(fd,OUTPUT_FLUSH_SIZE*2);
+    sb_append_str(&sb,"#include \"decls.h\"\n");
+    CURR_DEPTH = 0;
+    if( unit == 0 ) {
+        for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+            if( stm->type == AST_DECLARATION ) {
+                generate_decl(&sb,stm);
+            }
+        }
+    }
+    for( int i = start; i < end; i++ ) {
+        if( sb.length >= OUTPUT_FLUSH_SIZE ) {
+            sb_flush(&sb);
+        }
+        generate_func_decl(&sb,funcs[i]);
+    }
+    sb_flush(&sb);
+    sb_free(&sb);
+    close(fd);
+    return sb.written;
+}
+
+// Splits the functions over units translation units of about the same
+// number of tokens and compiles them with one gcc each. A unit's gcc starts
+// as soon as it is written so compiling overlaps the rest of codegen, the
+// objects are linked into OUTPUT_BINARY at the end. With the artifact cache
+// only units whose C changed are compiled and an unchanged program isnt linked.
+int compile_program_units(AstExpr* program, int units, size_t* output_len) {
+    OUTPUT_UNITS = units;
+    mkdir(OUTPUT_DIR, 0777);
+    mkdir(OUTPUT_UNITS_DIR, 0777);
+
+    int funcs_num = 0;
+    size_t tokens_num = 0;
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_FUNCTION_DECLARATION && Ast_func_reached(stm) ) {
+            funcs_num++;
+        }
+    }
+    AstExpr** funcs = (AstExpr**)malloc(sizeof(AstExpr*) * (funcs_num + 1));
+    ASSERT( (funcs != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    funcs_num = 0;
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_FUNCTION_DECLARATION && Ast_func_reached(stm) ) {
+            funcs[funcs_num++] = stm;
+            AstExpr* body = stm->function_declaration->body;
+            tokens_num += body->lazy_block->end - body->lazy_block->start;
+        }
+    }
+
+    *output_len = write_units_header(program);
+
+    pid_t* pids = (pid_t*)malloc(sizeof(pid_t) * units);
+    char** objects = (char**)malloc(sizeof(char*) * units);
+    ArtifactKey* keys = (ArtifactKey*)malloc(sizeof(ArtifactKey) * units);
+    ASSERT( (pids != NULL && objects != NULL && keys != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    char* compile_flags[] = { "-c", NULL };
+    ArtifactKey header_key;
+    if( ARTIFACT_CACHE ) {
+        header_key = ArtifactCache_add_file(gcc_artifact_key(compile_flags),OUTPUT_UNITS_DIR "/decls.h");
+    }
+    int start = 0;
+    size_t unit_tokens = 0;
+    for( int unit = 0; unit < units; unit++ ) {
+        // a unit ends once the units so far hold their share of all tokens
+        size_t share = tokens_num * (unit + 1) / units;
+        int end = start;
+        while( end < funcs_num && (unit == units - 1 || unit_tokens < share) ) {
+            AstExpr* body = funcs[end]->function_declaration->body;
+            unit_tokens += body->lazy_block->end - body->lazy_block->start;
+            end++;
+        }
+        *output_len += write_unit(program,unit,funcs,start,end);
+        start = end;
+
+        char source[64];
+        objects[unit] = (char*)malloc(64);
+        ASSERT( (objects[unit] != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+        snprintf(source,sizeof(source),"%s/u%d.c",OUTPUT_UNITS_DIR,unit);
+        snprintf(objects[unit],64,"%s/u%d.o",OUTPUT_UNITS_DIR,unit);
+        pids[unit] = -1;
+        if( ARTIFACT_CACHE ) {
+            keys[unit] = ArtifactCache_add_file(header_key,source);
+            if( ArtifactCache_fetch(keys[unit],objects[unit]) ) {
+                continue;
+            }
+        }
+        char* argv[24];
+        gcc_argv_compile(argv,source,objects[unit],compile_flags);
+        pids[unit] = spawn_process(argv,-1,-1);
+    }
+    free(funcs);
+
+    int failed = 0;
+    for( int unit = 0; unit < units; unit++ ) {
+        if( pids[unit] < 0 ) {
+            continue; // from the cache
+        }
+        int status = wait_process(pids[unit]);
+        if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+            printf("Compilation of %s/u%d.c failed\n",OUTPUT_UNITS_DIR,unit);
+            failed = 1;
+        } else if( ARTIFACT_CACHE ) {
+            ArtifactCache_store(keys[unit],objects[unit]);
+        }
+    }
+    free(pids);
+    if( failed ) {
+        PANIC("Compilation failed\n");
+    }
+
+    // the executable only depends on the objects, which the unit keys stand for
+    ArtifactKey link_key;
+    if( ARTIFACT_CACHE ) {
+        link_key = ArtifactCache_add(gcc_artifact_key(NULL),keys,sizeof(ArtifactKey) * units);
+    }
+    free(keys);
+    if( ARTIFACT_CACHE && ArtifactCache_fetch(link_key,OUTPUT_BINARY) ) {
+        for( int unit = 0; unit < units; unit++ ) {
+            free(objects[unit]);
+        }
+        free(objects);
+        printf("\e[0;32mCompiled ✓\e[0m (cached)\n");
+        return 0;
+    }
+
+    char** argv = (char**)malloc(sizeof(char*) * (units + 24));
+    ASSERT( (argv != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    int argc = gcc_argv(argv,NULL);
+    for( int unit = 0; unit < units; unit++ ) {
+        argv[argc++] = objects[unit];
+    }
+    argv[argc++] = "-o";
+    argv[argc++] = OUTPUT_BINARY;
+    argv[argc++] = NULL;
+    int result = wait_gcc(spawn_process(argv,-1,-1));
+    if( ARTIFACT_CACHE ) {
+        ArtifactCache_store(link_key,OUTPUT_BINARY);
+    }
+    for( int unit = 0; unit < units; unit++ ) {
+        free(objects[unit]);
+    }
+    free(objects);
+    free(argv);
+    return result;
+}
@@ -2,8 +2,35 @@
 #include "types.h"
 #include "my_string.h"
 #include "analyzer.h"
+#include <sys/types.h>
 
 void generate_expr_statement(StringBuilder* sb, AstExpr* stm);
-char* generate_output(AstExpr* node);
+#define OUTPUT_DIR       "out"
+#define OUTPUT_FILE      "out/out.c" // only written with --emit-c
+#define OUTPUT_BINARY    "out/out"
+#define OUTPUT_UNITS_DIR "out/units" // decls.h and u<N>.c with --jobs
+#define PGO_DIR          "out/pgo"   // one directory of .gcda files per program and build profile
+
+// How the generated C is emitted and which flags gcc gets, see BUILD_PROFILES
+typedef enum BuildProfile {
+    PROFILE_DEBUG,   // -O0 -g, indented output
+    PROFILE_RELEASE, // -O2, functions other than main are static, small ones static inline
+    PROFILE_NATIVE,  // release + -O3 -march=native -flto
+    PROFILE_COUNT,
+} BuildProfile;
+
+extern BuildProfile BUILD_PROFILE;
+extern int OUTPUT_UNITS;
+
+int set_build_profile(const char* name);
+const char* build_profile_name();
+
+size_t generate_output(AstExpr* node, int fd);
+size_t write_output(AstExpr* node);
 void generate_statements(StringBuilder* sb, AstExpr* stm);
-int compile_string(char* source);
+pid_t spawn_process(char** argv, int stdin_fd, int close_fd);
+int wait_process(pid_t pid);
+int compile_output();
+int compile_output_pgo(const char* train_cmd);
+int compile_program(AstExpr* node, size_t* output_len);
+int compile_program_units(AstExpr* program, int units, size_t* output_len);
@@ -0,0 +1,825 @@
+#include "backend_asm.h"
+#include "backend.h"
+#include "parser.h"
+#include "types.h"
+#include "my_string.h"
+#include "analyzer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define ASSERT(expr, fmt, ...) { \
+    if (!expr) { \
+        printf(fmt "\n", ##__VA_ARGS__); \
+        exit(-1); \
+    } \
+}
+#define PANIC(fmt, ...) { \
+    printf(fmt "\n", ##__VA_ARGS__); \
+    exit(-1); \
+}
+
+// gives up on the whole program, compile_program_asm returns 0 and the C backend takes over
+#define ASM_UNSUPPORTED(fmt, ...) { \
+    snprintf(ASM_UNSUPPORTED_REASON,sizeof(ASM_UNSUPPORTED_REASON),fmt,##__VA_ARGS__); \
+    longjmp(ASM_UNSUPPORTED_JMP,1); \
+}
+
+#define ASM_FLUSH_SIZE (64*1024)
+
+jmp_buf ASM_UNSUPPORTED_JMP;
+char    ASM_UNSUPPORTED_REASON[256];
+
+StringBuilder ASM_OUT;    // .text, streamed to OUTPUT_ASM
+StringBuilder ASM_RODATA; // string literals, written after the functions
+uint32_t      ASM_STRINGS = 0;
+uint32_t      ASM_LABELS  = 0;
+
+TypeId ASM_INT_TYPE;
+TypeId ASM_CHAR_PTR_TYPE;
+TypeId ASM_BOOL_TYPE;
+
+// frame of the function being generated. Locals are numbered the way the
+// analyzer binds them, args first, and a slot number is reused by sibling
+// blocks so ASM_SLOTS maps it to the variable declared last
+int32_t*  ASM_SLOTS      = NULL; // slot -> offset from %rbp
+uint32_t  ASM_SLOTS_CAP  = 0;
+uint32_t  ASM_SLOT_NEXT  = 0;
+uint32_t  ASM_FRAME_USED = 0;    // bytes below %rbp, sibling blocks share them
+uint32_t  ASM_FRAME_MAX  = 0;
+int       ASM_PUSHES     = 0;    // 8 byte temporaries on the stack, calls need %rsp 16 aligned
+
+typedef struct AsmFunc {
+    char*    name; // interned, NULL = empty slot
+    AstExpr* decl;
+    uint8_t  is_extern;
+} AsmFunc;
+
+AsmFunc*  ASM_FUNCS     = NULL; // name -> AsmFunc
+uint32_t  ASM_FUNCS_CAP = 0;    // power of 2
+
+const char* ASM_ARG_REGS_64[6] = { "%rdi", "%rsi", "%rdx", "%rcx", "%r8",  "%r9"  };
+const char* ASM_ARG_REGS_32[6] = { "%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d" };
+const char* ASM_ARG_REGS_8[6]  = { "%dil", "%sil", "%dl",  "%cl",  "%r8b", "%r9b" };
+
+TypeId asm_type(AstExpr* expr);
+void asm_value(StringBuilder* sb, AstExpr* expr);
+void asm_statements(StringBuilder* sb, AstExpr* stm);
+
+static AsmFunc* asm_func_slot(char* name) {
+    uint32_t mask = ASM_FUNCS_CAP - 1;
+    uint32_t i = Intern_hash(name) & mask;
+    while( ASM_FUNCS[i].name != NULL && ASM_FUNCS[i].name != name ) {
+        i = (i + 1) & mask;
+    }
+    return &ASM_FUNCS[i];
+}
+
+static void asm_add_funcs(AstExpr* stm, int is_extern, uint32_t* funcs_num) {
+    for( ; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_FUNCTION_DECLARATION ) {
+            if( funcs_num != NULL ) {
+                (*funcs_num)++;
+                continue;
+            }
+            AsmFunc* func = asm_func_slot(stm->function_declaration->name);
+            *func = (AsmFunc){ .name = stm->function_declaration->name, .decl = stm, .is_extern = is_extern };
+        } else if( stm->type == AST_EXTERN_STATEMENT ) {
+            AstExpr* body = stm->extern_statement.body;
+            asm_add_funcs(body->type == AST_BLOCK_STATEMENT ? body->block_statement.statements : body,1,funcs_num);
+        }
+    }
+}
+
+static AsmFunc* asm_func_find(char* name) {
+    AsmFunc* func = asm_func_slot(name);
+    if( func->name == NULL ) {
+        ASM_UNSUPPORTED("call of '%s' which isnt a top level or extern function",name);
+    }
+    return func;
+}
+
+// bytes of a value kept in %rax, 0 for structs and arrays which are handled by address
+static uint32_t asm_scalar_size(TypeId type_id) {
+    Type* type = Type_get(type_id);
+    switch( type->type_kind ) {
+        case PRIMITIVE_TYPE:
+            if( strcmp(type->type_name,"float") == 0 ) {
+                ASM_UNSUPPORTED("float values");
+            }
+            if( type->primitive_type.size == 0 ) {
+                ASM_UNSUPPORTED("use of a void value");
+            }
+            return type->primitive_type.size;
+        case POINTER_TYPE:
+        case FUNCTION_TYPE:
+            return 8;
+        case BOOL_TYPE:
+        case NUMBER_TYPE:
+            return 4;
+        case STRUCT_TYPE:
+        case ARRAY_TYPE:
+            return 0;
+        default:
+            ASM_UNSUPPORTED("values of type {%s}",Type_format_type_kind(*type));
+    }
+}
+
+static uint32_t asm_align_up(uint32_t value, uint32_t align) {
+    return (value + align - 1) / align * align;
+}
+
+// stack space in the current frame, returns its offset from %rbp
+static int32_t asm_alloc(uint32_t size, uint32_t align) {
+    ASM_FRAME_USED = asm_align_up(ASM_FRAME_USED + size,align);
+    if( ASM_FRAME_USED > ASM_FRAME_MAX ) {
+        ASM_FRAME_MAX = ASM_FRAME_USED;
+    }
+    return -(int32_t)ASM_FRAME_USED;
+}
+
+static void asm_bind_slot(int32_t offset) {
+    if( ASM_SLOT_NEXT == ASM_SLOTS_CAP ) {
+        ASM_SLOTS_CAP = ASM_SLOTS_CAP == 0 ? 64 : ASM_SLOTS_CAP * 2;
+        ASM_SLOTS = (int32_t*)realloc(ASM_SLOTS,sizeof(int32_t) * ASM_SLOTS_CAP);
+        ASSERT( (ASM_SLOTS != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    }
+    ASM_SLOTS[ASM_SLOT_NEXT++] = offset;
+}
+
+static void asm_push(StringBuilder* sb) {
+    sb_append_str(sb,"    pushq %rax\n");
+    ASM_PUSHES++;
+}
+
+static void asm_pop(StringBuilder* sb, const char* reg) {
+    sb_append(sb,"    popq %s\n",reg);
+    ASM_PUSHES--;
+}
+
+// %rax holds an address, replaces it with the value stored there
+static void asm_load(StringBuilder* sb, TypeId type) {
+    switch( asm_scalar_size(type) ) {
+        case 0:  break; // aggregates are their address
+        case 1:  sb_append_str(sb,"    movsbl (%rax), %eax\n"); break;
+        case 4:  sb_append_str(sb,"    movl (%rax), %eax\n");   break;
+        case 8:  sb_append_str(sb,"    movq (%rax), %rax\n");   break;
+        default: ASM_UNSUPPORTED("loads of %u bytes",asm_scalar_size(type));
+    }
+}
+
+// stores %rcx to the address in %rax, for aggregates %rcx is the address of the value
+static void asm_store(StringBuilder* sb, TypeId type) {
+    switch( asm_scalar_size(type) ) {
+        case 0:
+            sb_append(sb,"    movq %%rax, %%rdi\n    movq %%rcx, %%rsi\n    movl $%u, %%ecx\n    rep movsb\n",Type_size(type));
+            break;
+        case 1:  sb_append_str(sb,"    movb %cl, (%rax)\n");   break;
+        case 4:  sb_append_str(sb,"    movl %ecx, (%rax)\n");  break;
+        case 8:  sb_append_str(sb,"    movq %rcx, (%rax)\n");  break;
+        default: ASM_UNSUPPORTED("stores of %u bytes",asm_scalar_size(type));
+    }
+}
+
+// Numbers and int or pointer variables can be used by an instruction as they
+// are instead of going through %rax and the stack. Writes the operand to
+// buffer and returns it, NULL if expr has to be evaluated
+static const char* asm_operand(AstExpr* expr, char* buffer, size_t size) {
+    if( expr->type == AST_NUMBER ) {
+        for( int i = 0; i < expr->number.token.len; i++ ) {
+            if( expr->number.token.value[i] < '0' || expr->number.token.value[i] > '9' ) {
+                return NULL;
+            }
+        }
+        snprintf(buffer,size,"$%.*s",expr->number.token.len,expr->number.token.value);
+        return buffer;
+    }
+    if( expr->type != AST_IDENTIFIER ) {
+        return NULL;
+    }
+    uint32_t bytes = asm_scalar_size(*Ast_type(expr));
+    if( bytes != 4 && bytes != 8 ) {
+        return NULL; // chars need sign extending, aggregates are used by address
+    }
+    Binding binding = expr->identifier.binding;
+    if( binding.kind == BINDING_LOCAL ) {
+        snprintf(buffer,size,"%d(%%rbp)",ASM_SLOTS[binding.index]);
+    } else if( binding.kind == BINDING_GLOBAL ) {
+        snprintf(buffer,size,"%s(%%rip)",expr->identifier.token.value);
+    } else {
+        return NULL;
+    }
+    return buffer;
+}
+
+// the analyzer only records the types later phases used to need, the rest is derived here
+TypeId asm_type(AstExpr* expr) {
+    switch( expr->type ) {
+        case AST_NUMBER:     return ASM_INT_TYPE;
+        case AST_STRING:     return ASM_CHAR_PTR_TYPE;
+        case AST_IDENTIFIER: return *Ast_type(expr);
+        case AST_FUNC_CALL:
+            return asm_func_find(expr->func_call.name)->decl->function_declaration->return_type->id;
+        case AST_UNARY_OPERATION:
+            switch( expr->unary_operation.opp ) {
+                case NOT:       return ASM_BOOL_TYPE;
+                case AMPERSAND: return Type_pointer_to(asm_type(expr->unary_operation.right));
+                case STAR:      return Type_get(asm_type(expr->unary_operation.right))->pointer_type.sub_type->id;
+                default:        return asm_type(expr->unary_operation.right);
+            }
+        case AST_BINARY_OPERATION:
+            switch( expr->binary_operation.opp ) {
+                case STAR:
+                case PLUS:
+                case DIVITION:
+                case MINUS:
+                    return asm_type(expr->binary_operation.left);
+                default:
+                    return *Ast_type(expr);
+            }
+        default:
+            ASM_UNSUPPORTED("expression %s",format_ast_type(expr));
+    }
+}
+
+// leaves the address of an lvalue in %rax
+void asm_address(StringBuilder* sb, AstExpr* expr) {
+    if( expr->type == AST_IDENTIFIER ) {
+        Binding binding = expr->identifier.binding;
+        if( binding.kind == BINDING_LOCAL ) {
+            sb_append(sb,"    leaq %d(%%rbp), %%rax\n",ASM_SLOTS[binding.index]);
+        } else if( binding.kind == BINDING_GLOBAL ) {
+            sb_append(sb,"    leaq %s(%%rip), %%rax\n",expr->identifier.token.value);
+        } else {
+            ASM_UNSUPPORTED("'%s' used as a variable",expr->identifier.token.value);
+        }
+        return;
+    }
+    if( expr->type == AST_UNARY_OPERATION && expr->unary_operation.opp == STAR ) {
+        asm_value(sb,expr->unary_operation.right);
+        return;
+    }
+    if( expr->type == AST_BINARY_OPERATION && expr->binary_operation.opp == DOT ) {
+        AstExpr* left = expr->binary_operation.left;
+        Binding binding = expr->binary_operation.right->identifier.binding;
+        asm_value(sb,left); // structs and arrays are their address
+        if( binding.kind == BINDING_LENGTH ) {
+            sb_append_str(sb,"    addq $8, %rax\n");
+        } else {
+            StructField* field = &Type_get(asm_type(left))->struct_type.fields[binding.index];
+            if( field->offset != 0 ) {
+                sb_append(sb,"    addq $%u, %%rax\n",field->offset);
+            }
+        }
+        return;
+    }
+    if( expr->type == AST_BINARY_OPERATION && expr->binary_operation.opp == SUBSCRIPT_OPEN ) {
+        asm_value(sb,expr->binary_operation.left);
+        sb_append_str(sb,"    movq (%rax), %rax\n"); // __Array.data
+        asm_push(sb);
+        asm_value(sb,expr->binary_operation.right);
+        sb_append(sb,"    movslq %%eax, %%rcx\n    imulq $%u, %%rcx, %%rcx\n",Type_size(asm_type(expr)));
+        asm_pop(sb,"%rax");
+        sb_append_str(sb,"    addq %rcx, %rax\n");
+        return;
+    }
+    ASM_UNSUPPORTED("%s used as an lvalue",format_ast_type(expr));
+}
+
+static void asm_func_call(StringBuilder* sb, AstExpr* expr) {
+    AsmFunc* func = asm_func_find(expr->func_call.name);
+    int regs = 0;
+    for( AstExpr* arg = expr->func_call.args; arg != NULL; arg = arg->argument.next ) {
+        AstExpr* value = arg->argument.value->expression_statement.value;
+        TypeId type = asm_type(value);
+        Type* t = Type_get(type);
+        asm_value(sb,value);
+        if( t->type_kind == ARRAY_TYPE ) {
+            // __Array is two INTEGER eightbytes, data then length
+            sb_append_str(sb,"    pushq (%rax)\n    pushq 8(%rax)\n");
+            ASM_PUSHES += 2;
+            regs += 2;
+        } else if( t->type_kind == STRUCT_TYPE ) {
+            ASM_UNSUPPORTED("struct {%s} passed by value to %s",t->type_name,func->name);
+        } else {
+            asm_push(sb);
+            regs += 1;
+        }
+    }
+    if( regs > 6 ) {
+        ASM_UNSUPPORTED("call of %s needs more than 6 argument registers",func->name);
+    }
+    for( int i = regs - 1; i >= 0; i-- ) {
+        asm_pop(sb,ASM_ARG_REGS_64[i]);
+    }
+    int pad = ASM_PUSHES % 2 != 0;
+    if( pad ) {
+        sb_append_str(sb,"    subq $8, %rsp\n");
+    }
+    // %al is the number of vector registers used by a variadic call like printf
+    sb_append(sb,"    xorl %%eax, %%eax\n    call %s%s\n",func->name,func->is_extern ? "@PLT" : "");
+    if( pad ) {
+        sb_append_str(sb,"    addq $8, %rsp\n");
+    }
+    Type* return_type = Type_get(func->decl->function_declaration->return_type->id);
+    if( return_type->type_kind == STRUCT_TYPE || return_type->type_kind == ARRAY_TYPE ) {
+        ASM_UNSUPPORTED("%s returns {%s} by value",func->name,return_type->type_name);
+    }
+    if( return_type->type_kind == PRIMITIVE_TYPE && return_type->primitive_type.size == 1 ) {
+        sb_append_str(sb,"    movsbl %al, %eax\n");
+    }
+}
+
+// left in %rax and right in %rcx, or returns right as an operand without touching %rcx
+static const char* asm_operands(StringBuilder* sb, AstExpr* expr, uint32_t size, char* buffer, size_t buffer_size) {
+    const char* right = asm_operand(expr->binary_operation.right,buffer,buffer_size);
+    if( right != NULL ) {
+        asm_value(sb,expr->binary_operation.left);
+        return right;
+    }
+    asm_value(sb,expr->binary_operation.left);
+    asm_push(sb);
+    asm_value(sb,expr->binary_operation.right);
+    sb_append_str(sb,"    movq %rax, %rcx\n");
+    asm_pop(sb,"%rax");
+    return size == 8 ? "%rcx" : "%ecx";
+}
+
+static void asm_arithmetic(StringBuilder* sb, AstExpr* expr) {
+    uint32_t size = asm_scalar_size(asm_type(expr->binary_operation.left));
+    if( size == 0 ) {
+        ASM_UNSUPPORTED("arithmetic on structs or arrays");
+    }
+    char buffer[256];
+    const char* c = asm_operands(sb,expr,size,buffer,sizeof(buffer));
+    const char* s = size == 8 ? "q" : "l";
+    const char* a = size == 8 ? "%rax" : "%eax";
+    if( expr->binary_operation.opp == DIVITION && c == buffer ) {
+        // idiv takes no immediate
+        sb_append(sb,"    mov%s %s, %s\n",s,c,size == 8 ? "%rcx" : "%ecx");
+        c = size == 8 ? "%rcx" : "%ecx";
+    }
+    switch( expr->binary_operation.opp ) {
+        case PLUS:     sb_append(sb,"    add%s %s, %s\n",s,c,a);  break;
+        case MINUS:    sb_append(sb,"    sub%s %s, %s\n",s,c,a);  break;
+        case STAR:     sb_append(sb,"    imul%s %s, %s\n",s,c,a); break;
+        case DIVITION: sb_append(sb,"    %s\n    idiv%s %s\n",size == 8 ? "cqto" : "cltd",s,c); break;
+        default:       PANIC("%s %d: not arithmetic",__FILE__,__LINE__);
+    }
+}
+
+// condition code of a comparison, negate gives the one for jumping when it is false
+static const char* asm_condition(TokenKind kind, int is_unsigned, int negate) {
+    switch( kind ) {
+        case EQUAL:      return negate ? "ne" : "e";
+        case NOT_EQUAL:  return negate ? "e"  : "ne";
+        case LESS_THEN:  return is_unsigned ? (negate ? "ae" : "b")  : (negate ? "ge" : "l");
+        case MORE_THEN:  return is_unsigned ? (negate ? "be" : "a")  : (negate ? "le" : "g");
+        case LESS_EQUAL: return is_unsigned ? (negate ? "a"  : "be") : (negate ? "g"  : "le");
+        case MORE_EQUAL: return is_unsigned ? (negate ? "b"  : "ae") : (negate ? "l"  : "ge");
+        default:         PANIC("%s %d: not a comparison",__FILE__,__LINE__);
+    }
+}
+
+static int asm_is_comparison(AstExpr* expr) {
+    if( expr->type != AST_BINARY_OPERATION ) {
+        return 0;
+    }
+    switch( expr->binary_operation.opp ) {
+        case EQUAL:
+        case NOT_EQUAL:
+        case LESS_THEN:
+        case MORE_THEN:
+        case LESS_EQUAL:
+        case MORE_EQUAL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// emits the cmp and returns the condition code of expr
+static const char* asm_compare(StringBuilder* sb, AstExpr* expr, int negate) {
+    TypeId type = asm_type(expr->binary_operation.left);
+    uint32_t size = asm_scalar_size(type);
+    if( size == 0 ) {
+        ASM_UNSUPPORTED("comparison of structs or arrays");
+    }
+    int is_unsigned = Type_get(type)->type_kind == POINTER_TYPE || size == 8;
+    char buffer[256];
+    const char* c = asm_operands(sb,expr,size,buffer,sizeof(buffer));
+    sb_append(sb,"    cmp%s %s, %s\n",size == 8 ? "q" : "l",c,size == 8 ? "%rax" : "%eax");
+    return asm_condition(expr->binary_operation.opp,is_unsigned,negate);
+}
+
+static void asm_comparison(StringBuilder* sb, AstExpr* expr) {
+    sb_append(sb,"    set%s %%al\n    movzbl %%al, %%eax\n",asm_compare(sb,expr,0));
+}
+
+// jumps to label when condition is false
+static void asm_branch_false(StringBuilder* sb, AstExpr* condition, uint32_t label) {
+    if( asm_is_comparison(condition) ) {
+        sb_append(sb,"    j%s .L%u\n",asm_compare(sb,condition,1),label);
+        return;
+    }
+    asm_value(sb,condition);
+    sb_append(sb,"    testl %%eax, %%eax\n    je .L%u\n",label);
+}
+
+// value = address of the lvalue or aggregate it is stored to
+static void asm_assign(StringBuilder* sb, AstExpr* left, AstExpr* value) {
+    char buffer[256];
+    const char* dest = asm_operand(left,buffer,sizeof(buffer));
+    if( dest != NULL ) {
+        asm_value(sb,value);
+        sb_append(sb,asm_scalar_size(*Ast_type(left)) == 8 ? "    movq %%rax, %s\n" : "    movl %%eax, %s\n",dest);
+        return;
+    }
+    asm_value(sb,value);
+    asm_push(sb);
+    asm_address(sb,left);
+    asm_pop(sb,"%rcx");
+    asm_store(sb,asm_type(left));
+}
+
+// leaves the value of expr in %rax, structs and arrays leave their address
+void asm_value(StringBuilder* sb, AstExpr* expr) {
+    switch( expr->type ) {
+        case AST_NUMBER:
+            for( int i = 0; i < expr->number.token.len; i++ ) {
+                if( expr->number.token.value[i] < '0' || expr->number.token.value[i] > '9' ) {
+                    ASM_UNSUPPORTED("number literal %.*s",expr->number.token.len,expr->number.token.value);
+                }
+            }
+            sb_append(sb,"    movl $%.*s, %%eax\n",expr->number.token.len,expr->number.token.value);
+            return;
+        case AST_STRING:
+            sb_append(&ASM_RODATA,".LS%u:\n    .string \"%.*s\"\n",ASM_STRINGS,expr->string.token.len,expr->string.token.value);
+            sb_append(sb,"    leaq .LS%u(%%rip), %%rax\n",ASM_STRINGS++);
+            return;
+        case AST_IDENTIFIER: {
+            char buffer[256];
+            const char* operand = asm_operand(expr,buffer,sizeof(buffer));
+            if( operand != NULL ) {
+                sb_append(sb,asm_scalar_size(*Ast_type(expr)) == 8 ? "    movq %s, %%rax\n" : "    movl %s, %%eax\n",operand);
+                return;
+            }
+            asm_address(sb,expr);
+            asm_load(sb,asm_type(expr));
+            return;
+        }
+        case AST_FUNC_CALL:
+            asm_func_call(sb,expr);
+            return;
+        case AST_UNARY_OPERATION:
+            switch( expr->unary_operation.opp ) {
+                case AMPERSAND:
+                    asm_address(sb,expr->unary_operation.right);
+                    return;
+                case STAR:
+                    asm_address(sb,expr);
+                    asm_load(sb,asm_type(expr));
+                    return;
+                case NOT:
+                    asm_value(sb,expr->unary_operation.right);
+                    sb_append_str(sb,"    testl %eax, %eax\n    sete %al\n    movzbl %al, %eax\n");
+                    return;
+                case MINUS:
+                    if( asm_scalar_size(asm_type(expr->unary_operation.right)) != 4 ) {
+                        ASM_UNSUPPORTED("unary minus on {%s}",Type_get(asm_type(expr->unary_operation.right))->type_name);
+                    }
+                    asm_value(sb,expr->unary_operation.right);
+                    sb_append_str(sb,"    negl %eax\n");
+                    return;
+                case PLUS_PLUS:
+                case MINUS_MINUS: {
+                    TypeId type = asm_type(expr->unary_operation.right);
+                    if( asm_scalar_size(type) != 4 ) {
+                        ASM_UNSUPPORTED("increment of {%s}",Type_get(type)->type_name);
+                    }
+                    asm_address(sb,expr->unary_operation.right);
+                    sb_append(sb,"    %s $1, (%%rax)\n",expr->unary_operation.opp == PLUS_PLUS ? "addl" : "subl");
+                    asm_load(sb,type);
+                    return;
+                }
+                default:
+                    ASM_UNSUPPORTED("unary operator %s",format_enum((Token){ .kind = expr->unary_operation.opp }));
+            }
+        case AST_BINARY_OPERATION:
+            switch( expr->binary_operation.opp ) {
+                case STAR:
+                case PLUS:
+                case DIVITION:
+                case MINUS:
+                    asm_arithmetic(sb,expr);
+                    return;
+                case EQUAL:
+                case NOT_EQUAL:
+                case LESS_THEN:
+                case MORE_THEN:
+                case LESS_EQUAL:
+                case MORE_EQUAL:
+                    asm_comparison(sb,expr);
+                    return;
+                case ASSIGN:
+                    asm_assign(sb,expr->binary_operation.left,expr->binary_operation.right);
+                    return;
+                case DOT:
+                case SUBSCRIPT_OPEN:
+                    asm_address(sb,expr);
+                    asm_load(sb,asm_type(expr));
+                    return;
+                default:
+                    ASM_UNSUPPORTED("binary operator %s",format_enum((Token){ .kind = expr->binary_operation.opp }));
+            }
+        default:
+            ASM_UNSUPPORTED("expression %s",format_ast_type(expr));
+    }
+}
+
+// points the __Array at address to its backing storage
+static void asm_init_array(StringBuilder* sb, const char* address, const char* data, long length) {
+    sb_append(sb,"    leaq %s, %%rax\n    movq %%rax, %s\n",data,address);
+    sb_append(sb,"    leaq %s, %%rax\n    movl $%ld, 8(%%rax)\n",address,length);
+}
+
+// length of an array declaration, [] takes it from the value
+static long asm_array_length(AstExpr* decl) {
+    long length = decl->declaration->type->array_type.length;
+    if( length == -1 ) {
+        length = Type_get(*Ast_type(decl->declaration->value))->array_type.length;
+    }
+    return length;
+}
+
+static void asm_local_decl(StringBuilder* sb, AstExpr* stm) {
+    TypeId type = stm->declaration->type->id;
+    Type* t = Type_get(type);
+    int32_t offset;
+    if( t->type_kind == ARRAY_TYPE ) {
+        long length = asm_array_length(stm);
+        TypeId sub_type = t->array_type.sub_type->id;
+        int32_t data = asm_alloc(Type_size(sub_type) * length,Type_align(sub_type));
+        offset = asm_alloc(Type_size(type),Type_align(type));
+        char data_address[32];
+        char array_address[32];
+        snprintf(data_address,sizeof(data_address),"%d(%%rbp)",data);
+        snprintf(array_address,sizeof(array_address),"%d(%%rbp)",offset);
+        asm_init_array(sb,array_address,data_address,length);
+    } else {
+        asm_scalar_size(type); // rejects what cant be stored
+        offset = asm_alloc(Type_size(type),Type_align(type));
+    }
+    // the analyzer binds the var after its value, the value cant see it
+    AstExpr* value = stm->declaration->value->expression_statement.value;
+    if( value != NULL ) {
+        asm_value(sb,value);
+        switch( asm_scalar_size(type) ) {
+            case 0:
+                sb_append(sb,"    movq %%rax, %%rcx\n    leaq %d(%%rbp), %%rax\n",offset);
+                asm_store(sb,type);
+                break;
+            case 1: sb_append(sb,"    movb %%al, %d(%%rbp)\n",offset);  break;
+            case 4: sb_append(sb,"    movl %%eax, %d(%%rbp)\n",offset); break;
+            case 8: sb_append(sb,"    movq %%rax, %d(%%rbp)\n",offset); break;
+        }
+    }
+    asm_bind_slot(offset);
+}
+
+static void asm_block(StringBuilder* sb, AstExpr* stm) {
+    uint32_t slot_next  = ASM_SLOT_NEXT;
+    uint32_t frame_used = ASM_FRAME_USED;
+    asm_statements(sb,stm->block_statement.statements);
+    ASM_SLOT_NEXT  = slot_next;
+    ASM_FRAME_USED = frame_used;
+}
+
+void asm_statements(StringBuilder* sb, AstExpr* stm) {
+    for( ; stm != NULL; stm = Ast_next(stm) ) {
+        switch( stm->type ) {
+            case AST_BLOCK_STATEMENT:
+                asm_block(sb,stm);
+                break;
+            case AST_DECLARATION:
+                asm_local_decl(sb,stm);
+                break;
+            case AST_IF_STATEMENT: {
+                uint32_t label = ASM_LABELS++;
+                asm_branch_false(sb,stm->if_statement.condition->expression_statement.value,label);
+                asm_block(sb,stm->if_statement.body);
+                sb_append(sb,".L%u:\n",label);
+                break;
+            }
+            case AST_EXPRESSION_STATEMENT:
+                if( stm->expression_statement.value != NULL ) {
+                    asm_value(sb,stm->expression_statement.value);
+                }
+                break;
+            default:
+                ASM_UNSUPPORTED("%s",format_ast_type(stm));
+        }
+    }
+}
+
+// globals live in .bss, main stores their initial values before its body runs
+static void asm_init_globals(StringBuilder* sb, AstExpr* program) {
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type != AST_DECLARATION ) {
+            continue;
+        }
+        char* name = stm->declaration->name;
+        if( stm->declaration->type->type_kind == ARRAY_TYPE ) {
+            char data_address[256];
+            char array_address[256];
+            snprintf(data_address,sizeof(data_address),"__%s(%%rip)",name);
+            snprintf(array_address,sizeof(array_address),"%s(%%rip)",name);
+            asm_init_array(sb,array_address,data_address,asm_array_length(stm));
+        }
+        AstExpr* value = stm->declaration->value->expression_statement.value;
+        if( value != NULL ) {
+            asm_value(sb,value);
+            asm_push(sb);
+            sb_append(sb,"    leaq %s(%%rip), %%rax\n",name);
+            asm_pop(sb,"%rcx");
+            asm_store(sb,stm->declaration->type->id);
+        }
+    }
+}
+
+static void asm_globals(StringBuilder* sb, AstExpr* program) {
+    sb_append_str(sb,"    .bss\n");
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type != AST_DECLARATION ) {
+            continue;
+        }
+        TypeId type = stm->declaration->type->id;
+        Type* t = Type_get(type);
+        if( t->type_kind == ARRAY_TYPE ) {
+            TypeId sub_type = t->array_type.sub_type->id;
+            sb_append(sb,"    .balign %u\n__%s:\n    .zero %lu\n",Type_align(sub_type),stm->declaration->name,
+                      (unsigned long)Type_size(sub_type) * asm_array_length(stm));
+        } else {
+            asm_scalar_size(type);
+        }
+        sb_append(sb,"    .balign %u\n%s:\n    .zero %u\n",Type_align(type),stm->declaration->name,Type_size(type));
+    }
+}
+
+static void asm_func_decl(StringBuilder* sb, AstExpr* stm, AstExpr* program) {
+    if( !Ast_func_reached(stm) ) {
+        return;
+    }
+    char* name = stm->function_declaration->name;
+    if( Ast_func_cached(stm) ) {
+        ASM_UNSUPPORTED("%s comes from the incremental cache",name);
+    }
+    ASM_SLOT_NEXT  = 0;
+    ASM_FRAME_USED = 0;
+    ASM_FRAME_MAX  = 0;
+    ASM_PUSHES     = 0;
+    uint32_t frame = ASM_LABELS++;
+
+    sb_append(sb,"    .globl %s\n    .type %s, @function\n%s:\n",name,name,name);
+    // the frame size is only known at the end, as resolves the forward reference
+    sb_append(sb,"    pushq %%rbp\n    movq %%rsp, %%rbp\n    subq $.LF%u, %%rsp\n",frame);
+
+    int regs = 0;
+    for( AstExpr* arg = stm->function_declaration->args; arg != NULL; arg = arg->argument_decl.next ) {
+        TypeId type = arg->argument_decl.type->id;
+        Type* t = Type_get(type);
+        if( t->type_kind == STRUCT_TYPE ) {
+            ASM_UNSUPPORTED("struct {%s} argument of %s",t->type_name,name);
+        }
+        uint32_t size = asm_scalar_size(type);
+        int32_t offset = asm_alloc(Type_size(type),Type_align(type));
+        if( regs + (size == 0 ? 2 : 1) > 6 ) {
+            ASM_UNSUPPORTED("%s needs more than 6 argument registers",name);
+        }
+        switch( size ) {
+            case 0: // __Array
+                sb_append(sb,"    movq %s, %d(%%rbp)\n    movq %s, %d(%%rbp)\n",ASM_ARG_REGS_64[regs],offset,ASM_ARG_REGS_64[regs+1],offset + 8);
+                regs += 2;
+                break;
+            case 1: sb_append(sb,"    movb %s, %d(%%rbp)\n",ASM_ARG_REGS_8[regs++],offset);  break;
+            case 4: sb_append(sb,"    movl %s, %d(%%rbp)\n",ASM_ARG_REGS_32[regs++],offset); break;
+            case 8: sb_append(sb,"    movq %s, %d(%%rbp)\n",ASM_ARG_REGS_64[regs++],offset); break;
+            default: ASM_UNSUPPORTED("%u byte argument of %s",size,name);
+        }
+        asm_bind_slot(offset);
+    }
+
+    int is_main = strcmp(name,"main") == 0;
+    if( is_main ) {
+        asm_init_globals(sb,program);
+    }
+    asm_statements(sb,Ast_func_body(stm)->block_statement.statements);
+    if( is_main ) {
+        sb_append_str(sb,"    xorl %eax, %eax\n"); // falling off main returns 0
+    }
+    sb_append(sb,"    leave\n    ret\n    .size %s, .-%s\n    .set .LF%u, %u\n\n",name,name,frame,asm_align_up(ASM_FRAME_MAX,16));
+}
+
+// without crt1.o, the dynamic linker has already set up libc by the time
+// _start runs. exit flushes stdio
+const char ASM_START[] =
+    "    .globl _start\n"
+    "_start:\n"
+    "    xorl %ebp, %ebp\n"
+    "    movl (%rsp), %edi\n"
+    "    leaq 8(%rsp), %rsi\n"
+    "    call main\n"
+    "    movl %eax, %edi\n"
+    "    call exit@PLT\n"
+    "\n"
+;
+
+static void asm_program(StringBuilder* sb, AstExpr* program) {
+    uint32_t funcs_num = 0;
+    asm_add_funcs(program,0,&funcs_num);
+    ASM_FUNCS_CAP = 64;
+    while( ASM_FUNCS_CAP < funcs_num * 2 ) {
+        ASM_FUNCS_CAP *= 2;
+    }
+    ASM_FUNCS = (AsmFunc*)calloc(ASM_FUNCS_CAP,sizeof(AsmFunc));
+    ASSERT( (ASM_FUNCS != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    asm_add_funcs(program,0,NULL);
+
+    ASM_INT_TYPE      = Type_find_named(Intern("int"));
+    ASM_CHAR_PTR_TYPE = Type_pointer_to(Type_find_named(Intern("char")));
+    ASM_BOOL_TYPE     = Type_intern(Type_new(NULL,BOOL_TYPE));
+
+    sb_append_str(sb,"    .text\n");
+    sb_write_through(sb,ASM_START,sizeof(ASM_START)-1);
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_FUNCTION_DECLARATION ) {
+            asm_func_decl(sb,stm,program);
+        }
+        if( sb->length >= ASM_FLUSH_SIZE ) {
+            sb_flush(sb);
+        }
+    }
+    asm_globals(sb,program);
+    sb_append_str(sb,"    .section .rodata\n");
+    sb_write_through(sb,ASM_RODATA.buffer,ASM_RODATA.length);
+    sb_append_str(sb,"    .section .note.GNU-stack,\"\",@progbits\n");
+}
+
+// runs argv and panics with what if it fails
+static void asm_run(char** argv, const char* what) {
+    int status = wait_process(spawn_process(argv,-1,-1));
+    if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+        PANIC("%s failed",what);
+    }
+}
+
+// releases what asm_program built up, for the next call and the gcc fallback
+static void asm_free(int fd) {
+    sb_free(&ASM_OUT);
+    sb_free(&ASM_RODATA);
+    close(fd);
+    free(ASM_FUNCS);
+    ASM_FUNCS      = NULL;
+    ASM_FUNCS_CAP  = 0;
+    free(ASM_SLOTS);
+    ASM_SLOTS      = NULL;
+    ASM_SLOTS_CAP  = 0;
+    ASM_SLOT_NEXT  = 0;
+    ASM_FRAME_USED = 0;
+    ASM_FRAME_MAX  = 0;
+    ASM_PUSHES     = 0;
+}
+
+// Writes OUTPUT_ASM and builds OUTPUT_BINARY from it with as and ld.
+// Returns 0 without building anything if the program uses something this
+// backend doesnt support, the caller compiles it with gcc instead.
+int compile_program_asm(AstExpr* program, size_t* output_len) {
+    mkdir(OUTPUT_DIR, 0777);
+    int fd = open(OUTPUT_ASM, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) { PANIC("Failed to create %s",OUTPUT_ASM); }
+    ASM_OUT    = sb_new_fd(fd,ASM_FLUSH_SIZE*2);
+    ASM_RODATA = sb_new();
+
+    if( setjmp(ASM_UNSUPPORTED_JMP) != 0 ) {
+        asm_free(fd);
+        unlink(OUTPUT_ASM); // the start of it was already written
+        printf("asm backend: %s isnt supported, compiling with gcc\n",ASM_UNSUPPORTED_REASON);
+        return 0;
+    }
+    asm_program(&ASM_OUT,program);
+    sb_flush(&ASM_OUT);
+    *output_len = ASM_OUT.written;
+    asm_free(fd);
+
+    char* as_argv[] = { "as", "-o", OUTPUT_ASM_OBJECT, OUTPUT_ASM, NULL };
+    asm_run(as_argv,"Assembling");
+    char* ld_argv[] = { "ld", "-o", OUTPUT_BINARY, "-dynamic-linker", ASM_DYNAMIC_LINKER, OUTPUT_ASM_OBJECT, "-lc", NULL };
+    asm_run(ld_argv,"Linking");
+    printf("\e[0;32mAssembled ✓\e[0m\n");
+    return 1;
+}
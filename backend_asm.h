@@ -0,0 +1,21 @@
+#ifndef BACKEND_ASM_H
+#define BACKEND_ASM_H
+
+#include <stddef.h>
+#include "parser.h"
+
+//Asm backend
+// Generates x86-64 System V assembly straight from the analyzed AST and
+// builds it with as and ld, for debug builds that dont need gcc. Every
+// variable lives in its own stack slot and expressions are evaluated into
+// %rax with pushes for temporaries, nothing is optimized.
+// Programs using something it doesnt handle yet (floats, structs passed by
+// value, more than 6 argument registers) are left to the C backend.
+
+#define OUTPUT_ASM         "out/out.s"
+#define OUTPUT_ASM_OBJECT  "out/out.o"
+#define ASM_DYNAMIC_LINKER "/lib64/ld-linux-x86-64.so.2"
+
+int compile_program_asm(AstExpr* program, size_t* output_len);
+
+#endif
@@ -0,0 +1,114 @@
+#include "../lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// Lexer throughput on generated inputs of 1M, 10M and 50M tokens
+// (or the counts given as arguments), then lex_file against lex_file_old
+// on COMPARE_TOKENS tokens. See bench/run
+
+#define PANIC(fmt, ...) { \
+    printf(fmt "\n", ##__VA_ARGS__); \
+    exit(-1); \
+}
+
+// every function is the same tokens with a different name
+static const char* FUNC_TEMPLATE =
+    "fn func_%d(int count, *char label) -> int {\n"
+    "    total: int = count * 12 + 7;\n"
+    "    if total > 100 {\n"
+    "        printf(\"%%d\\n\", total);\n"
+    "    }\n"
+    "    while total != 0 {\n"
+    "        total = total - 1;\n"
+    "    }\n"
+    "}\n";
+#define FUNC_TOKENS 49
+
+#define COMPARE_TOKENS 10000000
+
+Lexer lex_file_old(String string);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// writes functions until the file has at least tokens tokens, returns its size
+static long generate_input(const char* path, long tokens) {
+    FILE* file = fopen(path,"w");
+    if( file == NULL ) {
+        PANIC("Failed to create %s",path);
+    }
+    for( long i = 0; i * FUNC_TOKENS < tokens; i++ ) {
+        fprintf(file,FUNC_TEMPLATE,(int)i);
+    }
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+int main(int argc, char** argv) {
+    long counts[16] = { 1000000, 10000000, 50000000 };
+    int counts_len = 3;
+    if( argc > 1 ) {
+        counts_len = 0;
+        for( int i = 1; i < argc && counts_len < 16; i++ ) {
+            counts[counts_len++] = atol(argv[i]);
+        }
+    }
+
+    char path[] = "/tmp/lex_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if( fd < 0 ) {
+        PANIC("Failed to create a temporary file");
+    }
+    close(fd);
+
+    printf("%12s %10s %10s %10s\n","tokens","MB","seconds","MB/s");
+    for( int i = 0; i < counts_len; i++ ) {
+        long size = generate_input(path,counts[i]);
+        String source = String_mapfile(path);
+
+        double start = now();
+        Lexer lexer = lex_file(source);
+        double seconds = now() - start;
+
+        double mb = size / (1024.0 * 1024.0);
+        printf("%12d %10.1f %10.3f %10.1f\n",lexer.tokens_len,mb,seconds,mb / seconds);
+        free(lexer.tokens);
+        String_unmap(&source);
+    }
+
+    // the new lexer also interns, scans with simd and uses threads, so this
+    // is everything that changed since, not only the tables
+    generate_input(path,COMPARE_TOKENS);
+    String source = String_mapfile(path);
+    double start = now();
+    Lexer old_lexer = lex_file_old(source);
+    double old_seconds = now() - start;
+    String new_source = String_mapfile(path);
+    start = now();
+    Lexer new_lexer = lex_file(new_source);
+    double new_seconds = now() - start;
+
+    if( old_lexer.tokens_len != new_lexer.tokens_len ) {
+        PANIC("old and new lex_file disagree: %d and %d tokens",old_lexer.tokens_len,new_lexer.tokens_len);
+    }
+    for( int i = 0; i < old_lexer.tokens_len; i++ ) {
+        Token a = old_lexer.tokens[i];
+        Token b = new_lexer.tokens[i];
+        if( a.kind != b.kind || ((a.kind == IDENT || a.kind == NUMBER || a.kind == STRING) && strcmp(a.value,b.value) != 0) ) {
+            PANIC("old and new lex_file disagree at token %d",i);
+        }
+    }
+    double mb = source.len / (1024.0 * 1024.0);
+    printf("\n%d tokens, %.1f MB, same tokens\n",new_lexer.tokens_len,mb);
+    printf("%12s %10.3f s %10.1f MB/s\n","lex_file_old",old_seconds,mb / old_seconds);
+    printf("%12s %10.3f s %10.1f MB/s\n","lex_file",new_seconds,mb / new_seconds);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "../lexer.h"
+#include <string.h>
+
+// lex_file as it was before the character class table and the keyword
+// switch, kept so lex_bench can compare against it. Identifiers are plain
+// slices here, not interned.
+
+#define ASSERT(expr, fmt, ...) { \
+    if (!expr) { \
+        printf(fmt "\n", ##__VA_ARGS__); \
+        exit(-1); \
+    } \
+}
+
+static int get_keyword_old(char* buff,int buff_len,Token* t) {
+    const char*     keywords[]      = {"extern","union","enum","struct","if","else","for","while","return","fn","EOF"};
+    const TokenKind keyword_kinds[] = { EXTERN , UNION , ENUM , STRUCT , IF , ELSE , FOR , WHILE , RETURN , FN , EOF_TOKEN};
+    const int len = sizeof(keywords) / sizeof(keywords[0]);
+
+    for ( int i = 0; i < len; i++) {
+        if( strncmp(buff,keywords[i],buff_len) == 0 && keywords[i][buff_len] == '\0' ) {
+            *t = (Token){ .kind=keyword_kinds[i] };
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int is_terminal_old(char c) {
+    const char terminals[] = {'&',':','!',',','.','[', ']', '(', '{', ')', '}', '=', '+', '-', '*', '/', '<', '>', ';', ' ', '\n','\"'};
+    const int len = sizeof(terminals) / sizeof(terminals[0]);
+
+    for ( int i = 0; i < len; i++) {
+        if ( c == terminals[i])
+            return 1;
+    }
+
+    return 0;
+}
+
+static void terminate_slices_old(Token* tokens, int tokens_len) {
+    for( int i = 0; i < tokens_len; i++ ) {
+        Token* t = &tokens[i];
+        if( t->kind != IDENT && t->kind != NUMBER && t->kind != STRING ) {
+            continue;
+        }
+        if( i + 1 < tokens_len && tokens[i+1].value == t->value + t->len ) {
+            char* copy = (char*)malloc(t->len + 1);
+            memcpy(copy,t->value,t->len);
+            copy[t->len] = '\0';
+            t->value = copy;
+        } else {
+            t->value[t->len] = '\0';
+        }
+    }
+}
+
+Lexer lex_file_old(String string) {
+    char c;
+    int tokens_cap = string.len / 4 + 16;
+    Token* tokens = (Token*)malloc(sizeof(Token)*tokens_cap);
+    ASSERT((tokens != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    int tokens_idx = 0;
+
+    while((c = String_getc(&string)) != EOF ) {
+        if( tokens_idx + 2 > tokens_cap ) {
+            tokens_cap *= 2;
+            tokens = (Token*)realloc(tokens,sizeof(Token)*tokens_cap);
+            ASSERT((tokens != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+        }
+        switch(c) {
+            case '&': tokens[tokens_idx++] = (Token){ .kind=AMPERSAND };            continue;
+            case ':': tokens[tokens_idx++] = (Token){ .kind=COLON };                continue;
+            case '(': tokens[tokens_idx++] = (Token){ .kind=OPEN_PARENT };          continue;
+            case ')': tokens[tokens_idx++] = (Token){ .kind=CLOSE_PARENT };         continue;
+            case '{': tokens[tokens_idx++] = (Token){ .kind=OPEN_CURRLY_PARENT };   continue;
+            case '}': tokens[tokens_idx++] = (Token){ .kind=CLOSE_CURRLY_PARENT };  continue;
+            case '*': tokens[tokens_idx++] = (Token){ .kind=STAR };                 continue;
+            case '/': tokens[tokens_idx++] = (Token){ .kind=DIVITION };             continue;
+            case ';': tokens[tokens_idx++] = (Token){ .kind=SEMICOLON };            continue;
+            case ',': tokens[tokens_idx++] = (Token){ .kind=COMMA };                continue;
+            case '.': tokens[tokens_idx++] = (Token){ .kind=DOT };                  continue;
+            case '[': tokens[tokens_idx++] = (Token){ .kind=SUBSCRIPT_OPEN };       continue;
+            case ']': tokens[tokens_idx++] = (Token){ .kind=SUBSCRIPT_CLOSE };      continue;
+            case '+':
+                if( String_getc(&string) == '+') {
+                    tokens[tokens_idx++] = (Token){ .kind=PLUS_PLUS };
+                } else {
+                    String_ungetc(&string);
+                    tokens[tokens_idx++] = (Token){ .kind=PLUS };
+                } continue;
+            case '-':
+                switch(String_getc(&string)) {
+                    case '-':
+                        tokens[tokens_idx++] = (Token){ .kind=MINUS_MINUS };
+                        break;
+                    case '>':
+                        tokens[tokens_idx++] = (Token){ .kind=ARROW };
+                        break;
+                    default:
+                        String_ungetc(&string);
+                        tokens[tokens_idx++] = (Token){ .kind=MINUS };
+                        break;
+                } continue;
+            case '<':
+                if( String_getc(&string) == '=') {
+                    tokens[tokens_idx++] = (Token){ .kind=LESS_EQUAL };
+                } else {
+                    String_ungetc(&string);
+                    tokens[tokens_idx++] = (Token){ .kind=LESS_THEN };
+                } continue;
+            case '>':
+                if( String_getc(&string) == '=') {
+                    tokens[tokens_idx++] = (Token){ .kind=MORE_EQUAL };
+                } else {
+                    String_ungetc(&string);
+                    tokens[tokens_idx++] = (Token){ .kind=MORE_THEN };
+                } continue;
+            case '=':
+                if( String_getc(&string) == '=') {
+                    tokens[tokens_idx++] = (Token){ .kind=EQUAL };
+                } else {
+                    String_ungetc(&string);
+                    tokens[tokens_idx++] = (Token){ .kind=ASSIGN };
+                } continue;
+            case '!':
+                if( String_getc(&string) == '=') {
+                    tokens[tokens_idx++] = (Token){ .kind=NOT_EQUAL };
+                } else {
+                    String_ungetc(&string);
+                    tokens[tokens_idx++] = (Token){ .kind=NOT };
+                } continue;
+        }
+        switch(c) {
+            case '\t':
+            case '\n':
+            case ' ':
+                continue;
+        }
+
+        int start = string.idx - 1;
+        if( c >= '0' && c <= '9' ) {
+            do {
+                c = String_getc(&string);
+            } while( c >= '0' && c <= '9' );
+            String_ungetc(&string);
+
+            tokens[tokens_idx++] = (Token){ .kind=NUMBER, .len = string.idx - start, .value = string.data + start };
+
+        } else if( c == '\"') {
+            start = string.idx;
+            c = String_getc(&string);
+            while( c != '\"' ) {
+                ASSERT( (c != EOF), "%s %d: Unterminated string literal",__FILE__,__LINE__);
+                c = String_getc(&string);
+            }
+
+            tokens[tokens_idx++] = (Token){ .kind=STRING, .len = string.idx - 1 - start, .value = string.data + start };
+        } else {
+            while(1) {
+                c = String_getc(&string);
+                if( c == EOF || is_terminal_old(c) ) {
+                    break;
+                }
+            }
+            String_ungetc(&string);
+
+            Token t = (Token){ .kind=IDENT, .len = string.idx - start, .value = string.data + start };
+            get_keyword_old(t.value,t.len,&t); // overwrites t if its a keyword
+            tokens[tokens_idx++] = t;
+        }
+    }
+    tokens[tokens_idx++] = (Token){ .kind = EOF_TOKEN };
+    terminate_slices_old(tokens,tokens_idx);
+    return Lexer_new(tokens,tokens_idx);
+}
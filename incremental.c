@@ -0,0 +1,291 @@
+#include "incremental.h"
+#include "my_string.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define ASSERT(expr, fmt, ...) { \
+    if (!expr) { \
+        printf(fmt "\n", ##__VA_ARGS__); \
+        exit(-1); \
+    } \
+}
+
+#define PANIC(fmt, ...) { \
+    printf(fmt "\n", ##__VA_ARGS__); \
+    exit(-1); \
+}
+
+// cache file: "INC1", uint32 entries, then per entry uint64 key, uint32 len, len bytes of C
+#define INCREMENTAL_MAGIC "INC1"
+
+typedef struct IncFunc {
+    char*    name;     // interned, NULL = empty slot
+    uint64_t sig_hash; // tokens from 'fn' up to the body
+    uint64_t key;
+    int      start;    // tokens[start] == FN
+    int      body;     // tokens[body] == '{'
+    int      end;      // one past the closing '}'
+} IncFunc;
+
+typedef struct IncEntry {
+    uint64_t    key; // 0 = empty slot
+    const char* c;
+    uint32_t    len;
+} IncEntry;
+
+int       INCREMENTAL    = 0;
+
+IncFunc*  INC_FUNCS      = NULL; // name -> IncFunc
+uint32_t  INC_FUNCS_CAP  = 0;    // power of 2
+
+IncEntry* INC_CACHE      = NULL; // key -> C from the last run, points into INC_CACHE_DATA
+uint32_t  INC_CACHE_CAP  = 0;    // power of 2
+char*     INC_CACHE_DATA = NULL;
+
+IncEntry* INC_NEXT       = NULL; // entries of the cache written by Incremental_save
+uint32_t  INC_NEXT_LEN   = 0;
+uint32_t  INC_NEXT_CAP   = 0;
+
+uint32_t  INC_REUSED     = 0;
+
+static uint64_t hash_mix(uint64_t h, uint64_t value) {
+    return Hash_fnv1a(h,&value,sizeof(value));
+}
+
+// whitespace and comments dont change the hash
+static uint64_t hash_tokens(uint64_t h, Token* tokens, int start, int end) {
+    for( int i = start; i < end; i++ ) {
+        Token t = tokens[i];
+        h = hash_mix(h,t.kind);
+        if( t.kind == IDENT || t.kind == NUMBER || t.kind == STRING ) {
+            h = Hash_fnv1a(h,t.value,t.len);
+        }
+    }
+    return h;
+}
+
+static IncFunc* inc_func_slot(char* name) {
+    uint32_t mask = INC_FUNCS_CAP - 1;
+    uint32_t i = Intern_hash(name) & mask;
+    while( INC_FUNCS[i].name != NULL && INC_FUNCS[i].name != name ) {
+        i = (i + 1) & mask;
+    }
+    return &INC_FUNCS[i];
+}
+
+// NULL if name isnt a top level function
+static IncFunc* inc_func_find(char* name) {
+    IncFunc* func = inc_func_slot(name);
+    return func->name == NULL ? NULL : func;
+}
+
+static IncEntry* inc_cache_find(uint64_t key) {
+    if( INC_CACHE_CAP == 0 ) {
+        return NULL;
+    }
+    uint32_t mask = INC_CACHE_CAP - 1;
+    uint32_t i = (uint32_t)(key >> 32) & mask;
+    while( INC_CACHE[i].key != 0 ) {
+        if( INC_CACHE[i].key == key ) {
+            return &INC_CACHE[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void inc_cache_read() {
+    FILE* file = fopen(INCREMENTAL_CACHE_FILE,"rb");
+    if( file == NULL ) {
+        return;
+    }
+    fseek(file,0,SEEK_END);
+    long size = ftell(file);
+    fseek(file,0,SEEK_SET);
+    INC_CACHE_DATA = (char*)malloc(size > 0 ? size : 1);
+    ASSERT( (INC_CACHE_DATA != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    size_t read = fread(INC_CACHE_DATA,1,size,file);
+    fclose(file);
+
+    uint32_t entries;
+    if( read != (size_t)size || size < 8 || memcmp(INC_CACHE_DATA,INCREMENTAL_MAGIC,4) != 0 ) {
+        return;
+    }
+    memcpy(&entries,INC_CACHE_DATA + 4,sizeof(entries));
+    // every record takes at least 12 bytes, a bigger count is a broken header
+    if( (size_t)entries > (size_t)(size - 8) / 12 ) {
+        return;
+    }
+
+    size_t cap = 64;
+    while( cap < (size_t)entries * 2 ) {
+        cap *= 2;
+    }
+    INC_CACHE_CAP = (uint32_t)cap;
+    INC_CACHE = (IncEntry*)calloc(cap,sizeof(IncEntry));
+    ASSERT( (INC_CACHE != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+
+    long pos = 8;
+    for( uint32_t n = 0; n < entries; n++ ) {
+        IncEntry entry;
+        if( pos + 12 > size ) {
+            break;
+        }
+        memcpy(&entry.key,INC_CACHE_DATA + pos,8);
+        memcpy(&entry.len,INC_CACHE_DATA + pos + 8,4);
+        entry.c = INC_CACHE_DATA + pos + 12;
+        pos += 12 + (long)entry.len;
+        if( pos > size ) {
+            break; // truncated, the entries read so far are still fine
+        }
+        uint32_t mask = INC_CACHE_CAP - 1;
+        uint32_t i = (uint32_t)(entry.key >> 32) & mask;
+        while( INC_CACHE[i].key != 0 && INC_CACHE[i].key != entry.key ) {
+            i = (i + 1) & mask;
+        }
+        INC_CACHE[i] = entry;
+    }
+}
+
+// Hashes the top level of lexer, reads the cache of the last run and marks
+// the functions of program that can be reused. Enables Incremental_store/save.
+void Incremental_load(Lexer* lexer, AstExpr* program, const char* variant) {
+    Token* tokens     = lexer->tokens;
+    int    tokens_len = lexer->tokens_len;
+    INCREMENTAL = 1;
+
+    uint32_t funcs_num = 0;
+    for( int i = 0; i < tokens_len && tokens[i].kind != EOF_TOKEN; i++ ) {
+        funcs_num += tokens[i].kind == FN;
+    }
+    INC_FUNCS_CAP = 64;
+    while( INC_FUNCS_CAP < funcs_num * 2 ) {
+        INC_FUNCS_CAP *= 2;
+    }
+    INC_FUNCS = (IncFunc*)calloc(INC_FUNCS_CAP,sizeof(IncFunc));
+    ASSERT( (INC_FUNCS != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+
+    // functions are hashed on their own, everything else goes into decls_hash
+    uint64_t decls_hash = Hash_fnv1a(FNV1A_INIT,variant,strlen(variant));
+    int i = 0;
+    while( tokens[i].kind != EOF_TOKEN ) {
+        int end = top_level_item_end(tokens,tokens_len,i);
+        if( end < 0 ) {
+            // the parser already accepted it so this cant happen, dont reuse anything
+            printf("incremental: couldnt split the top level, nothing reused\n");
+            INCREMENTAL = 0;
+            return;
+        }
+        if( tokens[i].kind == FN && tokens[i+1].kind == IDENT ) {
+            int body = i;
+            while( tokens[body].kind != OPEN_CURRLY_PARENT ) {
+                body++;
+            }
+            IncFunc* func = inc_func_slot(tokens[i+1].value);
+            if( func->name == NULL ) {
+                *func = (IncFunc){
+                    .name     = tokens[i+1].value,
+                    .sig_hash = hash_tokens(FNV1A_INIT,tokens,i,body),
+                    .start    = i,
+                    .body     = body,
+                    .end      = end,
+                };
+            }
+        } else {
+            decls_hash = hash_tokens(decls_hash,tokens,i,end);
+        }
+        i = end;
+    }
+
+    // a function depends on its own tokens, the declarations and the
+    // signature of every function its body names. A name that isnt a
+    // function counts too so adding or removing that function changes the key.
+    for( uint32_t n = 0; n < INC_FUNCS_CAP; n++ ) {
+        IncFunc* func = &INC_FUNCS[n];
+        if( func->name == NULL ) {
+            continue;
+        }
+        uint64_t key = hash_tokens(decls_hash,tokens,func->start,func->end);
+        for( int t = func->body; t < func->end; t++ ) {
+            if( tokens[t].kind == IDENT ) {
+                IncFunc* callee = inc_func_find(tokens[t].value);
+                key = hash_mix(key,callee == NULL ? 0 : callee->sig_hash);
+            }
+        }
+        func->key = key == 0 ? 1 : key; // 0 marks an empty cache slot
+    }
+
+    inc_cache_read();
+
+    uint32_t reached = 0;
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type != AST_FUNCTION_DECLARATION || !Ast_func_reached(stm) ) {
+            continue;
+        }
+        reached++;
+        IncFunc* func = inc_func_find(stm->function_declaration->name);
+        if( func != NULL && inc_cache_find(func->key) != NULL ) {
+            stm->function_declaration->body->lazy_block->cached = 1;
+            INC_REUSED++;
+        }
+    }
+    printf("incremental: %u of %u functions reused\n",INC_REUSED,reached);
+}
+
+// C generated for func in the last run, func has to be cached
+const char* Incremental_fragment(AstExpr* func) {
+    IncFunc* inc_func = inc_func_find(func->function_declaration->name);
+    ASSERT( (inc_func != NULL) ,"%s %d: %s isnt a top level function",__FILE__,__LINE__,func->function_declaration->name);
+    IncEntry* entry = inc_cache_find(inc_func->key);
+    ASSERT( (entry != NULL) ,"%s %d: %s isnt cached",__FILE__,__LINE__,func->function_declaration->name);
+    Incremental_store(func,entry->c,entry->len);
+    return INC_NEXT[INC_NEXT_LEN-1].c; // the copy is terminated, entry->c isnt
+}
+
+// records the C of func for the next run, c is copied
+void Incremental_store(AstExpr* func, const char* c, size_t len) {
+    if( !INCREMENTAL ) {
+        return;
+    }
+    IncFunc* inc_func = inc_func_find(func->function_declaration->name);
+    if( inc_func == NULL ) {
+        return;
+    }
+    if( INC_NEXT_LEN == INC_NEXT_CAP ) {
+        INC_NEXT_CAP = INC_NEXT_CAP == 0 ? 64 : INC_NEXT_CAP * 2;
+        INC_NEXT = (IncEntry*)realloc(INC_NEXT,sizeof(IncEntry)*INC_NEXT_CAP);
+        ASSERT( (INC_NEXT != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    }
+    char* copy = (char*)malloc(len + 1);
+    ASSERT( (copy != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    memcpy(copy,c,len);
+    copy[len] = '\0';
+    INC_NEXT[INC_NEXT_LEN++] = (IncEntry){ .key = inc_func->key, .c = copy, .len = (uint32_t)len };
+}
+
+// replaces the cache with the functions stored in this run
+void Incremental_save() {
+    if( !INCREMENTAL ) {
+        return;
+    }
+    mkdir("out", 0777);
+    mkdir(INCREMENTAL_CACHE_DIR, 0777);
+    FILE* file = fopen(INCREMENTAL_CACHE_FILE ".tmp","wb");
+    if( file == NULL ) {
+        printf("incremental: failed to write %s\n",INCREMENTAL_CACHE_FILE);
+        return;
+    }
+    fwrite(INCREMENTAL_MAGIC,1,4,file);
+    fwrite(&INC_NEXT_LEN,sizeof(INC_NEXT_LEN),1,file);
+    for( uint32_t n = 0; n < INC_NEXT_LEN; n++ ) {
+        fwrite(&INC_NEXT[n].key,8,1,file);
+        fwrite(&INC_NEXT[n].len,4,1,file);
+        fwrite(INC_NEXT[n].c,1,INC_NEXT[n].len,file);
+    }
+    fclose(file);
+    // the old cache stays valid until the new one is complete
+    rename(INCREMENTAL_CACHE_FILE ".tmp",INCREMENTAL_CACHE_FILE);
+}
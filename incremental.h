@@ -0,0 +1,26 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lexer.h"
+#include "parser.h"
+
+//Incremental
+// Reuses the generated C of functions that didnt change since the last
+// --incremental run. Every function gets a key hashed from its own tokens,
+// the signatures of the functions its body names and every other top level
+// item (structs, globals, externs). Functions whose key is in the cache are
+// marked cached: their bodies are not parsed, analyzed or generated.
+// The generated C depends on the build profile and on --jobs, the caller
+// names that variant and it is part of every key.
+
+#define INCREMENTAL_CACHE_DIR  "out/cache"
+#define INCREMENTAL_CACHE_FILE "out/cache/functions"
+
+void Incremental_load(Lexer* lexer, AstExpr* program, const char* variant);
+const char* Incremental_fragment(AstExpr* func);
+void Incremental_store(AstExpr* func, const char* c, size_t len);
+void Incremental_save();
+
+#endif
@@ -1,5 +1,8 @@
 #include "lexer.h"
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #define PANIC(fmt, ...) { \
     printf(fmt "\n", ##__VA_ARGS__); \
@@ -66,38 +69,221 @@ const char* format_enum(Token k) {
     }
 }
 
-int get_keyword(char* buff,Token* t) {
-    const char*     keywords[]      = {"extern","union","enum","struct","if","else","for","while","return","fn","EOF"};
-    const TokenKind keyword_kinds[] = { EXTERN , UNION , ENUM , STRUCT , IF , ELSE , FOR , WHILE , RETURN , FN , EOF_TOKEN};
-    const int len = sizeof(keywords) / sizeof(keywords[0]);
+#define KEYWORD(str,token_kind) \
+    if( memcmp(buff,str,buff_len) == 0 ) { *t = (Token){ .kind=token_kind }; return 0; }
 
-    for ( int i = 0; i < len; i++) {
-        if( strcmp(buff,keywords[i]) == 0 ) {
-            *t = (Token){ .kind=keyword_kinds[i] };
-            return 0;
-        }
+// switch on length and first char, at most one memcmp per identifier
+int get_keyword(char* buff,int buff_len,Token* t) {
+    switch( buff_len ) {
+        case 2:
+            switch( buff[0] ) {
+                case 'i': KEYWORD("if",IF); break;
+                case 'f': KEYWORD("fn",FN); break;
+            } break;
+        case 3:
+            switch( buff[0] ) {
+                case 'f': KEYWORD("for",FOR); break;
+                case 'E': KEYWORD("EOF",EOF_TOKEN); break;
+            } break;
+        case 4:
+            switch( buff[0] ) {
+                case 'e':
+                    switch( buff[1] ) {
+                        case 'l': KEYWORD("else",ELSE); break;
+                        case 'n': KEYWORD("enum",ENUM); break;
+                    } break;
+            } break;
+        case 5:
+            switch( buff[0] ) {
+                case 'u': KEYWORD("union",UNION); break;
+                case 'w': KEYWORD("while",WHILE); break;
+            } break;
+        case 6:
+            switch( buff[0] ) {
+                case 'e': KEYWORD("extern",EXTERN); break;
+                case 's': KEYWORD("struct",STRUCT); break;
+                case 'r': KEYWORD("return",RETURN); break;
+            } break;
     }
     return -1;
 }
+#undef KEYWORD
+
+#define CHAR_TERMINAL  1
+#define CHAR_DIGIT     2
+#define CHAR_NUL       4  // end of buffer sentinel
+#define CHAR_SPACE     8
+#define CHAR_IDENT_END (CHAR_TERMINAL | CHAR_NUL)
+
+static const uint8_t CHAR_CLASS[256] = {
+    ['&'] = CHAR_TERMINAL, [':'] = CHAR_TERMINAL, ['!'] = CHAR_TERMINAL, [','] = CHAR_TERMINAL,
+    ['.'] = CHAR_TERMINAL, ['['] = CHAR_TERMINAL, [']'] = CHAR_TERMINAL, ['('] = CHAR_TERMINAL,
+    ['{'] = CHAR_TERMINAL, [')'] = CHAR_TERMINAL, ['}'] = CHAR_TERMINAL, ['='] = CHAR_TERMINAL,
+    ['+'] = CHAR_TERMINAL, ['-'] = CHAR_TERMINAL, ['*'] = CHAR_TERMINAL, ['/'] = CHAR_TERMINAL,
+    ['<'] = CHAR_TERMINAL, ['>'] = CHAR_TERMINAL, [';'] = CHAR_TERMINAL, [' '] = CHAR_TERMINAL | CHAR_SPACE,
+    ['\n'] = CHAR_TERMINAL | CHAR_SPACE, ['\"'] = CHAR_TERMINAL, ['\t'] = CHAR_SPACE,
+    ['0' ... '9'] = CHAR_DIGIT,
+    ['\0'] = CHAR_NUL,
+};
 
 int is_terminal(char c) {
-    const char terminals[] = {'&',':','!',',','.','[', ']', '(', '{', ')', '}', '=', '+', '-', '*', '/', '<', '>', ';', ' ', '\n','\"'};
-    const int len = sizeof(terminals) / sizeof(terminals[0]);
+    return CHAR_CLASS[(unsigned char)c] & CHAR_TERMINAL;
+}
+
+// ================== scanners ==================
+// Each scanner returns the index of the first byte at or after idx that
+// doesnt belong to the run. data[len] has to be the NUL sentinel.
+// The vector versions never read past data[len-1] and finish with the scalar one.
+
+int scan_whitespace_scalar(const char* data, int idx, int len) {
+    while( idx < len && (data[idx] == ' ' || data[idx] == '\n' || data[idx] == '\t') ) {
+        idx++;
+    }
+    return idx;
+}
+
+int scan_ident_scalar(const char* data, int idx, int len) {
+    const unsigned char* p   = (const unsigned char*)data + idx;
+    const unsigned char* end = (const unsigned char*)data + len;
+    while(1) {
+        while( !(CHAR_CLASS[*p] & CHAR_IDENT_END) ) {
+            p++;
+        }
+        if( *p != '\0' || p >= end ) {
+            break;
+        }
+        p++; // NUL inside the file is part of the identifier like any other non terminal
+    }
+    return (const char*)p - data;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+int scan_whitespace_sse2(const char* data, int idx, int len) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i nl    = _mm_set1_epi8('\n');
+    const __m128i tab   = _mm_set1_epi8('\t');
+    while( idx + 16 <= len ) {
+        __m128i v  = _mm_loadu_si128((const __m128i*)(data + idx));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,space),_mm_cmpeq_epi8(v,nl)),_mm_cmpeq_epi8(v,tab));
+        unsigned mask = ~_mm_movemask_epi8(ws) & 0xFFFF;
+        if( mask ) {
+            return idx + __builtin_ctz(mask);
+        }
+        idx += 16;
+    }
+    return scan_whitespace_scalar(data,idx,len);
+}
+
+// [A-Za-z0-9_] is never a terminal, the vector loop skips those and the scalar
+// table decides on anything else, so the result is the same as scan_ident_scalar
+int scan_ident_sse2(const char* data, int idx, int len) {
+    const __m128i lower_bit  = _mm_set1_epi8(0x20);
+    const __m128i a          = _mm_set1_epi8('a');
+    const __m128i zero       = _mm_set1_epi8('0');
+    const __m128i letters    = _mm_set1_epi8(25);
+    const __m128i digits     = _mm_set1_epi8(9);
+    const __m128i underscore = _mm_set1_epi8('_');
+    while(1) {
+        while( idx + 16 <= len ) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + idx));
+            __m128i l = _mm_sub_epi8(_mm_or_si128(v,lower_bit),a);
+            __m128i d = _mm_sub_epi8(v,zero);
+            __m128i ident = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(l,letters),l), _mm_cmpeq_epi8(_mm_min_epu8(d,digits),d)),
+                _mm_cmpeq_epi8(v,underscore));
+            unsigned mask = ~_mm_movemask_epi8(ident) & 0xFFFF;
+            if( mask ) {
+                idx += __builtin_ctz(mask);
+                break;
+            }
+            idx += 16;
+        }
+        if( idx + 16 > len ) {
+            return scan_ident_scalar(data,idx,len);
+        }
+        // idx < len here so a NUL is inside the file and belongs to the identifier
+        if( CHAR_CLASS[(unsigned char)data[idx]] & CHAR_TERMINAL ) {
+            return idx;
+        }
+        idx++;
+    }
+}
 
-    for ( int i = 0; i < len; i++) {
-        if ( c == terminals[i])
-            return 1;
+__attribute__((target("avx2")))
+int scan_whitespace_avx2(const char* data, int idx, int len) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i nl    = _mm256_set1_epi8('\n');
+    const __m256i tab   = _mm256_set1_epi8('\t');
+    while( idx + 32 <= len ) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*)(data + idx));
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,space),_mm256_cmpeq_epi8(v,nl)),_mm256_cmpeq_epi8(v,tab));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(ws);
+        if( mask ) {
+            return idx + __builtin_ctz(mask);
+        }
+        idx += 32;
+    }
+    return scan_whitespace_sse2(data,idx,len);
+}
+
+__attribute__((target("avx2")))
+int scan_ident_avx2(const char* data, int idx, int len) {
+    const __m256i lower_bit  = _mm256_set1_epi8(0x20);
+    const __m256i a          = _mm256_set1_epi8('a');
+    const __m256i zero       = _mm256_set1_epi8('0');
+    const __m256i letters    = _mm256_set1_epi8(25);
+    const __m256i digits     = _mm256_set1_epi8(9);
+    const __m256i underscore = _mm256_set1_epi8('_');
+    while(1) {
+        while( idx + 32 <= len ) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + idx));
+            __m256i l = _mm256_sub_epi8(_mm256_or_si256(v,lower_bit),a);
+            __m256i d = _mm256_sub_epi8(v,zero);
+            __m256i ident = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(l,letters),l), _mm256_cmpeq_epi8(_mm256_min_epu8(d,digits),d)),
+                _mm256_cmpeq_epi8(v,underscore));
+            unsigned mask = ~(unsigned)_mm256_movemask_epi8(ident);
+            if( mask ) {
+                idx += __builtin_ctz(mask);
+                break;
+            }
+            idx += 32;
+        }
+        if( idx + 32 > len ) {
+            return scan_ident_sse2(data,idx,len);
+        }
+        if( CHAR_CLASS[(unsigned char)data[idx]] & CHAR_TERMINAL ) {
+            return idx;
+        }
+        idx++;
     }
+}
+#endif
+
+int (*SCAN_WHITESPACE)(const char* data, int idx, int len) = scan_whitespace_scalar;
+int (*SCAN_IDENT)(const char* data, int idx, int len)      = scan_ident_scalar;
 
-    return 0;
+void Lexer_init_scanners() {
+#if defined(__x86_64__)
+    // SSE2 is part of x86-64
+    SCAN_WHITESPACE = scan_whitespace_sse2;
+    SCAN_IDENT      = scan_ident_sse2;
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx2") ) {
+        SCAN_WHITESPACE = scan_whitespace_avx2;
+        SCAN_IDENT      = scan_ident_avx2;
+    }
+#endif
 }
 
-Lexer Lexer_new(Token* tokens) {
-    return (Lexer){.tokens = tokens, .idx = -1};
+Lexer Lexer_new(Token* tokens, int tokens_len) {
+    return (Lexer){.tokens = tokens, .tokens_len = tokens_len, .idx = -1};
 }
 
 Token Lexer_next(Lexer* lexer) {
-    if( lexer->tokens[lexer->idx].kind == EOF_TOKEN) {
+    if( lexer->idx >= 0 && lexer->tokens[lexer->idx].kind == EOF_TOKEN) {
         return (Token){ .kind= EOF_TOKEN};
     }
     Token next = lexer->tokens[++lexer->idx];
@@ -121,15 +307,63 @@ Token Lexer_peek_back(Lexer* lexer) {
     return Lexer_peek_n(lexer,-1);
 }
 
-Lexer lex_file(String string) {
+// Slices can only be terminated after the whole file is lexed, the byte after a slice
+// is the start of the next token. If that token is itself a slice the slice is copied instead.
+// IDENT values are interned so they are never slices.
+void terminate_slices(Token* tokens, int tokens_len) {
+    for( int i = 0; i < tokens_len; i++ ) {
+        Token* t = &tokens[i];
+        if( t->kind != NUMBER && t->kind != STRING ) {
+            continue;
+        }
+        if( i + 1 < tokens_len && tokens[i+1].value == t->value + t->len ) {
+            char* copy = (char*)malloc(t->len + 1);
+            memcpy(copy,t->value,t->len);
+            copy[t->len] = '\0';
+            t->value = copy;
+        } else {
+            t->value[t->len] = '\0';
+        }
+    }
+}
+
+typedef struct LexChunk {
+    String   string;     // lexes string.idx .. string.len
+    Token*   tokens;     // without EOF_TOKEN
+    int      tokens_len;
+    Interner intern_cache;
+} LexChunk;
+
+// chunk->string.len has to be the end of the buffer or right after a newline
+// thats outside of a string literal so no token crosses the end
+void* lex_chunk(void* arg) {
+    LexChunk* chunk = (LexChunk*)arg;
+    String string = chunk->string;
     char c;
-    char tmp[100];
-    int tmp_idx = 0;
-    Token* tokens = (Token*)malloc(sizeof(Token)*1000);
+    // capacity hint from the chunk size, the buffer doubles from there
+    // so big files lex with O(log n) reallocations
+    int tokens_cap = (string.len - string.idx) / 4 + 16;
+    Token* tokens = (Token*)malloc(sizeof(Token)*tokens_cap);
+    ASSERT((tokens != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
     int tokens_idx = 0;
 
-    while((c = String_getc(&string)) != EOF ) {
-        ASSERT((tokens_idx < 1000),"%s %d: EXEEDED MAX TOKENS",__FILE__,__LINE__);
+    while(1) {
+        // most runs are a single space, only long ones go to the vector scanner
+        if( CHAR_CLASS[(unsigned char)string.data[string.idx]] & CHAR_SPACE ) {
+            string.idx++;
+            if( CHAR_CLASS[(unsigned char)string.data[string.idx]] & CHAR_SPACE ) {
+                string.idx = SCAN_WHITESPACE(string.data,string.idx,string.len);
+            }
+        }
+        if( (c = String_getc(&string)) == EOF ) {
+            break;
+        }
+        // every iteration pushes at most one token, keep one slot for EOF_TOKEN
+        if( tokens_idx + 2 > tokens_cap ) {
+            tokens_cap *= 2;
+            tokens = (Token*)realloc(tokens,sizeof(Token)*tokens_cap);
+            ASSERT((tokens != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+        }
         switch(c) {
             case '&': tokens[tokens_idx++] = (Token){ .kind=AMPERSAND };                continue;
             case ':': tokens[tokens_idx++] = (Token){ .kind=COLON };                continue;
@@ -193,61 +427,167 @@ Lexer lex_file(String string) {
                     tokens[tokens_idx++] = (Token){ .kind=NOT };      
                 } continue;
         }
-        switch(c) {
-            case '\t':
-            case '\n':
-            case ' ':
-                continue;
-        }
 
-        if( c >= '0' && c <= '9' ) {
-            do {
-                tmp[tmp_idx++] = c; 
-                c = String_getc(&string);
-            } while( c >= '0' && c <= '9' );
-            String_ungetc(&string);
-
-            tmp[tmp_idx++] = '\0'; tmp_idx = 0;
+        int start = string.idx - 1;
+        if( CHAR_CLASS[(unsigned char)c] & CHAR_DIGIT ) {
+            const unsigned char* p = (const unsigned char*)string.data + string.idx;
+            while( CHAR_CLASS[*p] & CHAR_DIGIT ) {
+                p++;
+            }
+            string.idx = (char*)p - string.data;
 
-            Token t = (Token){ .kind=NUMBER, .value = (char*)malloc(sizeof(char)*100) };
-            strncpy(t.value,tmp,100);
-            tokens[tokens_idx++] = t;
+            tokens[tokens_idx++] = (Token){ .kind=NUMBER, .len = string.idx - start, .value = string.data + start };
 
         } else if( c == '\"') {
-            c = String_getc(&string);
-            while( c != '\"' || c == EOF) {
-                tmp[tmp_idx++] = c; 
-                c = String_getc(&string);
-            }
+            start = string.idx;
+            // glibc memchr is already vectorized and dispatched on the cpu
+            char* close = memchr(string.data + start,'\"',string.len - start);
+            ASSERT( (close != NULL), "%s %d: Unterminated string literal",__FILE__,__LINE__);
+            string.idx = close - string.data + 1;
 
-            tmp[tmp_idx++] = '\0'; tmp_idx = 0;
+            tokens[tokens_idx++] = (Token){ .kind=STRING, .len = string.idx - 1 - start, .value = string.data + start };
+        } else {
+            // short identifiers are done before the vector scanner pays off
+            const unsigned char* p = (const unsigned char*)string.data + string.idx;
+            int n = 0;
+            while( n < 8 && !(CHAR_CLASS[p[n]] & CHAR_IDENT_END) ) {
+                n++;
+            }
+            string.idx += n;
+            if( n == 8 || (p[n] == '\0' && string.idx < string.len) ) {
+                string.idx = SCAN_IDENT(string.data,string.idx,string.len);
+            }
 
-            Token t = (Token){ .kind=STRING, .value = (char*)malloc(sizeof(char)*100) };
-            strncpy(t.value,tmp,100);
+            Token t = (Token){ .kind=IDENT, .len = string.idx - start, .value = string.data + start };
+            if( get_keyword(t.value,t.len,&t) == -1 ) { // overwrites t if its a keyword
+                t.value = Intern_n_cached(&chunk->intern_cache,t.value,t.len);
+            }
             tokens[tokens_idx++] = t;
-        } else {
-            while(1) {
-                tmp[tmp_idx++] = c; 
+        }
+    }
+    terminate_slices(tokens,tokens_idx);
+    chunk->tokens     = tokens;
+    chunk->tokens_len = tokens_idx;
+    return NULL;
+}
+
+#define LEX_MIN_CHUNK_SIZE (1024*1024)
+#define LEX_MAX_CHUNKS     64
 
-                c = String_getc(&string);
-                if( is_terminal(c) ) {
-                    break;
-                }
+// Splits string into at most max_chunks chunks, every chunk but the last
+// ends right after a newline that isnt inside a string literal.
+// String literals have no escapes so a quote always flips the state.
+// Returns the number of chunks, ends[i] is the end of chunk i.
+int split_chunks(String string, int max_chunks, int* ends) {
+    int chunks = 0;
+    int pos = 0;    // quote parity at pos is always even
+    for( int i = 1; i < max_chunks; i++ ) {
+        long target = (long)string.len * i / max_chunks;
+        if( target <= pos ) {
+            continue;
+        }
+        // skip whole string literals up to the target
+        while( pos < target ) {
+            char* open = memchr(string.data + pos,'\"',target - pos);
+            if( open == NULL ) {
+                pos = target;
+                break;
             }
+            char* close = memchr(open + 1,'\"',string.data + string.len - (open + 1));
+            if( close == NULL ) {
+                return chunks; // unterminated string, the last chunk reports it
+            }
+            pos = close - string.data + 1;
+        }
+        char* nl = memchr(string.data + pos,'\n',string.len - pos);
+        while( nl != NULL ) {
+            // a string literal opening before the newline moves it
+            char* open = memchr(string.data + pos,'\"',nl - (string.data + pos));
+            if( open == NULL ) {
+                break;
+            }
+            char* close = memchr(open + 1,'\"',string.data + string.len - (open + 1));
+            if( close == NULL ) {
+                return chunks;
+            }
+            pos = close - string.data + 1;
+            if( close > nl ) {
+                nl = memchr(string.data + pos,'\n',string.len - pos);
+            }
+        }
+        if( nl == NULL ) {
+            break;
+        }
+        pos = nl - string.data + 1;
+        ends[chunks++] = pos;
+    }
+    return chunks;
+}
+
+// Big files are split at newlines and the chunks are lexed on worker threads,
+// the token arrays are then concatenated so the result is the same as lexing serially
+Lexer lex_file(String string) {
+    Lexer_init_scanners();
 
-            String_ungetc(&string);
-            tmp[tmp_idx++] = '\0'; tmp_idx = 0;
+    int max_chunks = sysconf(_SC_NPROCESSORS_ONLN);
+    if( max_chunks > LEX_MAX_CHUNKS ) {
+        max_chunks = LEX_MAX_CHUNKS;
+    }
+    if( max_chunks > string.len / LEX_MIN_CHUNK_SIZE ) {
+        max_chunks = string.len / LEX_MIN_CHUNK_SIZE;
+    }
 
-            Token t;
-            if( get_keyword(tmp,&t) != -1 ) {
-                tokens[tokens_idx++] = t;
-            } else {
-                t = (Token){ .kind=IDENT, .value = (char*)malloc(sizeof(char)*100) };
-                strncpy(t.value,tmp,100);
-                tokens[tokens_idx++] = t;
+    int ends[LEX_MAX_CHUNKS];
+    int chunks_num = 0;
+    if( max_chunks > 1 ) {
+        chunks_num = split_chunks(string,max_chunks,ends);
+    }
+    ends[chunks_num++] = string.len; // last chunk
+
+    LexChunk chunks[LEX_MAX_CHUNKS];
+    for( int i = 0; i < chunks_num; i++ ) {
+        chunks[i].string     = string;
+        chunks[i].string.idx = i == 0 ? string.idx : ends[i-1];
+        chunks[i].string.len = ends[i];
+        chunks[i].intern_cache = Interner_new();
+    }
+
+    if( chunks_num == 1 ) {
+        lex_chunk(&chunks[0]);
+    } else {
+        pthread_t threads[LEX_MAX_CHUNKS];
+        for( int i = 1; i < chunks_num; i++ ) {
+            if( pthread_create(&threads[i],NULL,lex_chunk,&chunks[i]) != 0 ) {
+                PANIC("%s %d: Failed to create lexer thread",__FILE__,__LINE__);
             }
         }
+        lex_chunk(&chunks[0]);
+        for( int i = 1; i < chunks_num; i++ ) {
+            pthread_join(threads[i],NULL);
+        }
+    }
+
+    Token* tokens;
+    int tokens_len = 0;
+    if( chunks_num == 1 ) {
+        tokens = chunks[0].tokens; // lex_chunk leaves room for EOF_TOKEN
+        tokens_len = chunks[0].tokens_len;
+    } else {
+        for( int i = 0; i < chunks_num; i++ ) {
+            tokens_len += chunks[i].tokens_len;
+        }
+        tokens = (Token*)malloc(sizeof(Token)*(tokens_len+1));
+        ASSERT((tokens != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+        tokens_len = 0;
+        for( int i = 0; i < chunks_num; i++ ) {
+            memcpy(tokens + tokens_len,chunks[i].tokens,sizeof(Token)*chunks[i].tokens_len);
+            tokens_len += chunks[i].tokens_len;
+            free(chunks[i].tokens);
+        }
+    }
+    for( int i = 0; i < chunks_num; i++ ) {
+        Interner_free(&chunks[i].intern_cache);
     }
-    tokens[tokens_idx++] = (Token){ .kind = EOF_TOKEN };
-    return Lexer_new(tokens);
+    tokens[tokens_len++] = (Token){ .kind = EOF_TOKEN };
+    return Lexer_new(tokens,tokens_len);
 }
@@ -57,17 +57,24 @@ typedef enum TokenKind {
 
 } TokenKind ;
 
+// NUMBER and STRING tokens are slices of the source buffer:
+// value points into the source and len is the slice length.
+// lex_file NUL terminates the slices in place once the whole file is lexed.
+// IDENT values are interned (see Intern_n), equal names have equal pointers.
 typedef struct Token {
     TokenKind kind;
+    int len;
     char* value;
 } Token;
 
 typedef struct Lexer {
     int idx;
-    Token* tokens;
+    Token* tokens;     // contiguous, last token is EOF_TOKEN
+    int tokens_len;
 } Lexer;
 
 
+Lexer Lexer_new(Token* tokens, int tokens_len);
 Token Lexer_peek_n(Lexer* lexer, int n);
 Token Lexer_next(Lexer* lexer);
 Token Lexer_peek(Lexer* lexer);
@@ -75,6 +82,7 @@ Token Lexer_curr(Lexer* lexer);
 Token Lexer_peek_back(Lexer* lexer);
 
 int is_terminal(char c);
+void Lexer_init_scanners();
 Lexer lex_file(String string);
 const char* format_enum(Token k);
 
@@ -1,12 +1,16 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "lexer.h"
 #include "my_string.h"
 #include "parser.h"
 #include "analyzer.h"
 #include "backend.h"
+#include "incremental.h"
+#include "artifact_cache.h"
+#include "backend_asm.h"
 
 #define PANIC(fmt, ...) { \
     printf(fmt "\n", ##__VA_ARGS__); \
@@ -16,9 +20,55 @@
 #include "print_ast.h"
 
 int main(int argc, char* argv[]) {
-    FILE* f = fopen("./input3.txt","r");
+    int incremental = 0;
+    int emit_c      = 0;
+    char* pgo_train = NULL;
+    int jobs        = 1;
+    int cache       = 0;
+    int use_asm     = 0;
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp(argv[i],"--incremental") == 0 ) {
+            incremental = 1;
+        } else if( strcmp(argv[i],"--emit-c") == 0 ) {
+            emit_c = 1;
+        } else if( strcmp(argv[i],"--profile") == 0 && i + 1 < argc ) {
+            i++;
+            if( !set_build_profile(argv[i]) ) {
+                PANIC("Unknown profile: %s, expected debug, release or native",argv[i]);
+            }
+        } else if( strcmp(argv[i],"--pgo") == 0 && i + 1 < argc ) {
+            pgo_train = argv[++i];
+        } else if( strcmp(argv[i],"--asm") == 0 ) {
+            use_asm = 1;
+        } else if( strcmp(argv[i],"--cache") == 0 ) {
+            cache = 1;
+        } else if( strcmp(argv[i],"--jobs") == 0 && i + 1 < argc ) {
+            char* end;
+            jobs = (int)strtol(argv[++i],&end,10);
+            if( *end != '\0' || jobs < 0 ) {
+                PANIC("--jobs expects a number, 0 for one per core: %s",argv[i]);
+            }
+            if( jobs == 0 ) {
+                jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        } else {
+            PANIC("Unknown option: %s\nusage: %s [--incremental] [--emit-c] [--profile debug|release|native] [--pgo TRAINING_COMMAND] [--jobs N] [--cache] [--asm]",argv[i],argv[0]);
+        }
+    }
+    if( pgo_train != NULL && BUILD_PROFILE == PROFILE_DEBUG ) {
+        set_build_profile("release"); // profiles are for optimizing, -O0 ignores them
+    }
+    if( pgo_train != NULL && jobs > 1 ) {
+        PANIC("--pgo builds a single translation unit, it cant be used with --jobs");
+    }
+    if( use_asm && (BUILD_PROFILE != PROFILE_DEBUG || jobs > 1 || incremental) ) {
+        PANIC("--asm is for debug builds, it cant be used with --profile, --pgo, --jobs or --incremental");
+    }
+    if( cache ) {
+        ArtifactCache_init();
+    }
 
-    String source = String_readfile(f);
+    String source = String_mapfile("./input3.txt");
     //printf("source: \n%s",source.data);
     //printf("============= end source ===============\n\n");
 
@@ -28,7 +78,7 @@ int main(int argc, char* argv[]) {
 
     Lexer lexer = lex_file(source);
 
-    for( int n = 0; lexer.tokens[n-1].kind != EOF_TOKEN ; n++) {
+    for( int n = 0; n == 0 || lexer.tokens[n-1].kind != EOF_TOKEN ; n++) {
         Token t = lexer.tokens[n];
         printf("%d: %s ",n,format_enum(t));
         switch(t.kind) {
@@ -42,15 +92,46 @@ int main(int argc, char* argv[]) {
     /*
     */
 
-    AstExpr* program = parse_program(&lexer);
-
-    print_program_ast(program);
+    Arena ast_arena = Arena_new();
+    AstExpr* program = parse_program(&lexer,&ast_arena);
+    if( incremental ) {
+        // the C of a function depends on the profile and on being split into units
+        char variant[64];
+        snprintf(variant,sizeof(variant),"%s%s",build_profile_name(),jobs > 1 ? "+units" : "");
+        Incremental_load(&lexer,program,variant);
+    }
 
     analyze_program_ast(program);
+    print_program_ast(program); // after analysis, printing parses every reached body on this thread
+    // bodies are parsed on demand during analysis, the workers arenas are merged into ast_arena by now
+    printf("AST arena: %u nodes, %zu bytes used, %zu bytes reserved\n",Ast_nodes_num(),ast_arena.allocated,Arena_reserved(&ast_arena));
+    printf("AST types: %u expressions, %zu bytes\n",Ast_exprs_num(),Ast_exprs_num()*sizeof(TypeId));
     
-    const char* output = generate_output(program);
-    printf("Output:\n%s",output);
-    compile_string(output);
+    size_t output_len;
+    if( pgo_train != NULL ) {
+        // both builds and the .gcda files need the same source file
+        output_len = write_output(program);
+        printf("Output: %s, %zu bytes\n",OUTPUT_FILE,output_len);
+        compile_output_pgo(pgo_train);
+    } else if( use_asm && compile_program_asm(program,&output_len) ) {
+        printf("Output: %s, %zu bytes\n",OUTPUT_ASM,output_len);
+    } else if( jobs > 1 ) {
+        // the units are files anyway, --emit-c changes nothing
+        compile_program_units(program,jobs,&output_len);
+        printf("Output: %s, %zu bytes in %d units\n",OUTPUT_UNITS_DIR,output_len,jobs);
+    } else if( emit_c || cache ) {
+        // the cache key needs the whole C before gcc runs, so it cant be piped
+        output_len = write_output(program);
+        printf("Output: %s, %zu bytes\n",OUTPUT_FILE,output_len);
+        compile_output();
+    } else {
+        compile_program(program,&output_len);
+        printf("Output: %zu bytes piped to gcc\n",output_len);
+    }
+    Incremental_save();
+    ArtifactCache_finish();
     /*
     */
+    Arena_free(&ast_arena);
+    Ast_free_types();
 }
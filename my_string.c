@@ -1,5 +1,12 @@
 #include<stdio.h>
 #include<stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/uio.h>
 #include "my_string.h"
 #include "parser.h"
 
@@ -15,17 +22,57 @@ String String_readfile(FILE* file) {
     char* buff = (char*)malloc(filesize+1);
     fread(buff,1,filesize,file);
     fseek(file, 0, SEEK_SET);
-    buff[filesize+1] = '\0';
+    buff[filesize] = '\0';
     String string;
     string.data = buff;
     string.len = filesize;
     string.idx = 0;
+    string.mapped = 0;
     return string;
 }
 
+// Maps the file instead of copying it. The mapping is private and writable so the
+// lexer can NUL terminate token slices in place without touching the file.
+// One zero byte is kept past the end so the source is NUL terminated like String_readfile.
+String String_mapfile(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if( fd < 0 ) { PANIC("Failed to open file: %s",path); }
+
+    struct stat st;
+    if( fstat(fd,&st) != 0 ) { PANIC("Failed to stat file: %s",path); }
+    long filesize = st.st_size;
+
+    // anonymous region first so the extra byte exists even when the file ends on a page boundary
+    char* buff = mmap(NULL, filesize+1, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if( buff == MAP_FAILED ) { PANIC("MMAP ERROR"); }
+    if( filesize > 0 ) {
+        if( mmap(buff, filesize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED ) {
+            PANIC("Failed to map file: %s",path);
+        }
+    }
+    close(fd);
+
+    String string;
+    string.data = buff;
+    string.len = filesize;
+    string.idx = 0;
+    string.mapped = 1;
+    return string;
+}
+
+void String_unmap(String* string) {
+    if( string->mapped ) {
+        munmap(string->data, string->len+1);
+    } else {
+        free(string->data);
+    }
+    string->data = NULL;
+}
+
+// idx moves past the end too, so String_ungetc after EOF stays balanced
 char String_getc(String* string) {
-    if( string->idx < string->len ) {
-        return string->data[string->idx++];
+    if( string->idx++ < string->len ) {
+        return string->data[string->idx-1];
     } else {
         return EOF;
     }
@@ -38,11 +85,154 @@ void String_ungetc(String* string) {
 #include <string.h>
 #include <stdarg.h>
 
+//String Interner
+
+#define INTERN_BLOCK_SIZE (64*1024)
+
+uint64_t Hash_fnv1a(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for( size_t i = 0; i < len; i++ ) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint32_t intern_hash(const char* str, int len) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for( int i = 0; i < len; i++ ) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+Interner Interner_new() {
+    Interner interner;
+        interner.capacity   = 1024;
+        interner.count      = 0;
+        interner.entries    = calloc(interner.capacity,sizeof(InternEntry));
+        interner.block      = NULL;
+        interner.block_left = 0;
+    if( interner.entries == NULL ) { PANIC("MALLOC ERROR"); }
+    return interner;
+}
+
+// frees the table, the strings stay valid
+void Interner_free(Interner* interner) {
+    free(interner->entries);
+    interner->entries = NULL;
+}
+
+static void interner_grow(Interner* interner) {
+    size_t new_capacity = interner->capacity * 2;
+    InternEntry* new_entries = calloc(new_capacity,sizeof(InternEntry));
+    if( new_entries == NULL ) { PANIC("MALLOC ERROR"); }
+
+    for( size_t i = 0; i < interner->capacity; i++ ) {
+        InternEntry e = interner->entries[i];
+        if( e.str == NULL ) {
+            continue;
+        }
+        size_t slot = e.hash & (new_capacity - 1);
+        while( new_entries[slot].str != NULL ) {
+            slot = (slot + 1) & (new_capacity - 1);
+        }
+        new_entries[slot] = e;
+    }
+    free(interner->entries);
+    interner->entries  = new_entries;
+    interner->capacity = new_capacity;
+}
+
+static char* interner_store(Interner* interner, const char* str, int len) {
+    if( (size_t)len + 1 > interner->block_left ) {
+        size_t size = len + 1 > INTERN_BLOCK_SIZE ? len + 1 : INTERN_BLOCK_SIZE;
+        interner->block = malloc(size);
+        if( interner->block == NULL ) { PANIC("MALLOC ERROR"); }
+        interner->block_left = size;
+    }
+    char* copy = interner->block;
+    memcpy(copy,str,len);
+    copy[len] = '\0';
+    interner->block      += len + 1;
+    interner->block_left -= len + 1;
+    return copy;
+}
+
+// returns the slot of str or the empty slot where it belongs
+static size_t interner_find(Interner* interner, const char* str, int len, uint32_t hash) {
+    size_t mask = interner->capacity - 1;
+    size_t slot = hash & mask;
+    while( interner->entries[slot].str != NULL ) {
+        InternEntry* e = &interner->entries[slot];
+        if( e->hash == hash && e->len == len && memcmp(e->str,str,len) == 0 ) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void interner_put(Interner* interner, size_t slot, char* str, int len, uint32_t hash) {
+    interner->entries[slot] = (InternEntry){ .str = str, .len = len, .hash = hash };
+    interner->count++;
+    if( interner->count * 2 > interner->capacity ) { // keep load under 1/2
+        interner_grow(interner);
+    }
+}
+
+char* Interner_get(Interner* interner, const char* str, int len) {
+    uint32_t hash = intern_hash(str,len);
+    size_t   slot = interner_find(interner,str,len,hash);
+    if( interner->entries[slot].str != NULL ) {
+        return interner->entries[slot].str;
+    }
+    char* copy = interner_store(interner,str,len);
+    interner_put(interner,slot,copy,len,hash);
+    return copy;
+}
+
+Interner GLOBAL_INTERNER;
+pthread_mutex_t GLOBAL_INTERNER_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// thread safe
+char* Intern_n(const char* str, int len) {
+    pthread_mutex_lock(&GLOBAL_INTERNER_LOCK);
+    if( GLOBAL_INTERNER.entries == NULL ) {
+        GLOBAL_INTERNER = Interner_new();
+    }
+    char* interned = Interner_get(&GLOBAL_INTERNER,str,len);
+    pthread_mutex_unlock(&GLOBAL_INTERNER_LOCK);
+    return interned;
+}
+
+// cache is a thread local Interner that maps to the global pointers,
+// only misses take the global lock
+char* Intern_n_cached(Interner* cache, const char* str, int len) {
+    uint32_t hash = intern_hash(str,len);
+    size_t   slot = interner_find(cache,str,len,hash);
+    if( cache->entries[slot].str != NULL ) {
+        return cache->entries[slot].str;
+    }
+    char* interned = Intern_n(str,len);
+    interner_put(cache,slot,interned,len,hash);
+    return interned;
+}
+
+char* Intern(const char* str) {
+    return Intern_n(str,strlen(str));
+}
+
+//String Builder
+
 StringBuilder sb_new() {
     StringBuilder sb;
         sb.capacity = 128;
         sb.length = 0;
         sb.buffer = malloc(sb.capacity);
+        sb.fd = -1;
+        sb.written = 0;
         if (sb.buffer) {
             sb.buffer[0] = '\0';
         } else {
@@ -51,6 +241,63 @@ StringBuilder sb_new() {
     return sb;
 }
 
+// Output builder, the caller flushes it to fd at points where nothing points
+// into the buffer so it only ever holds the text appended since the last flush
+StringBuilder sb_new_fd(int fd, size_t capacity) {
+    StringBuilder sb = sb_new();
+    sb_reserve(&sb, capacity);
+    sb.fd = fd;
+    return sb;
+}
+
+static void sb_writev(StringBuilder* sb, struct iovec* iov, int iov_len) {
+    for (int i = 0; i < iov_len; i++) {
+        sb->written += iov[i].iov_len;
+    }
+    while (iov_len > 0) {
+        ssize_t written = writev(sb->fd, iov, iov_len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PANIC("%s %d: write failed: %s", __FILE__, __LINE__, strerror(errno));
+        }
+        while (iov_len > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iov_len--;
+        }
+        if (iov_len > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+void sb_flush(StringBuilder* sb) {
+    if (sb->fd < 0 || sb->length == 0) {
+        return;
+    }
+    struct iovec iov[1] = { { .iov_base = sb->buffer, .iov_len = sb->length } };
+    sb_writev(sb, iov, 1);
+    sb_reset(sb);
+}
+
+// Appends str without copying it into the buffer, the buffer and str go
+// out in one writev. Falls back to sb_append_n for in memory builders.
+void sb_write_through(StringBuilder* sb, const char* str, size_t len) {
+    if (sb->fd < 0) {
+        sb_append_n(sb, str, len);
+        return;
+    }
+    struct iovec iov[2] = {
+        { .iov_base = sb->buffer,  .iov_len = sb->length },
+        { .iov_base = (char*)str,  .iov_len = len },
+    };
+    sb_writev(sb, iov, 2);
+    sb_reset(sb);
+}
+
 void sb_reset(StringBuilder* sb) {
     sb->length = 0;
     sb->buffer[0] = '\0';
@@ -60,41 +307,64 @@ void sb_free(StringBuilder* sb) {
     free(sb->buffer);
 }
 
-void sb_append(StringBuilder* sb, const char* fmt, ...) {
-    va_list args;
-
-    // Try to print to a temporary buffer to get required size
-    va_start(args, fmt);
-    int needed = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-
-    if (sb->length + needed + 1 > sb->capacity) {
-        // Resize buffer
-        while (sb->length + needed + 1 > sb->capacity) {
+// makes room for extra more bytes and the terminating '\0'
+void sb_reserve(StringBuilder* sb, size_t extra) {
+    if (sb->length + extra + 1 > sb->capacity) {
+        while (sb->length + extra + 1 > sb->capacity) {
             sb->capacity *= 2;
         }
         sb->buffer = realloc(sb->buffer, sb->capacity);
+        if (sb->buffer == NULL) {
+            PANIC("MALLOC ERROR");
+        }
     }
+}
+
+void sb_append_n(StringBuilder* sb, const char* str, size_t len) {
+    sb_reserve(sb, len);
+    memcpy(sb->buffer + sb->length, str, len);
+    sb->length += len;
+    sb->buffer[sb->length] = '\0';
+}
 
-    // Append the formatted string
+void sb_append_str(StringBuilder* sb, const char* str) {
+    sb_append_n(sb, str, strlen(str));
+}
+
+void sb_append_char(StringBuilder* sb, char c) {
+    sb_reserve(sb, 1);
+    sb->buffer[sb->length++] = c;
+    sb->buffer[sb->length] = '\0';
+}
+
+// formats straight into the free space, only formats again if it didnt fit
+void sb_append(StringBuilder* sb, const char* fmt, ...) {
+    va_list args;
+
+    size_t free_space = sb->capacity - sb->length;
     va_start(args, fmt);
-    vsprintf(sb->buffer + sb->length, fmt, args);
+    int needed = vsnprintf(sb->buffer + sb->length, free_space, fmt, args);
     va_end(args);
 
+    if ((size_t)needed >= free_space) {
+        sb_reserve(sb, needed);
+        va_start(args, fmt);
+        vsnprintf(sb->buffer + sb->length, needed + 1, fmt, args);
+        va_end(args);
+    }
+
     sb->length += needed;
 }
 
 void print_expr_to_sb(StringBuilder* sb,AstExpr* expr);
 
 void print_args_to_sb(StringBuilder* sb, AstExpr* arg) {
-    if( arg == NULL) {
-        // TODO change to subtract from the sb instead of printing \b
-        sb_append(sb,"\b\b");
-        return;
-    } 
-    print_expr_to_sb(sb,arg->argument.value);
-    sb_append(sb,", ");
-    print_args_to_sb(sb,arg->argument.next);
+    for( ; arg != NULL; arg = arg->argument.next ) {
+        print_expr_to_sb(sb,arg->argument.value);
+        sb_append(sb,", ");
+    }
+    // TODO change to subtract from the sb instead of printing \b
+    sb_append(sb,"\b\b");
 }
 
 void print_expr_to_sb(StringBuilder* sb,AstExpr* expr) {
@@ -110,12 +380,12 @@ void print_expr_to_sb(StringBuilder* sb,AstExpr* expr) {
             sb_append(sb,"%s",expr->identifier.token.value);
             return;
         case AST_STRING:
-            sb_append(sb,"\"%s\"",expr->identifier.token.value);
+            sb_append(sb,"\"%s\"",expr->string.token.value);
             return;
     }
     if( expr->type == AST_UNARY_OPERATION ) {
         sb_append(sb,"(");
-        switch (expr->unary_operation.opp_token.kind) {
+        switch (expr->unary_operation.opp) {
             case NOT:
                 sb_append(sb,"!"); break;
             case MINUS:
@@ -133,7 +403,7 @@ void print_expr_to_sb(StringBuilder* sb,AstExpr* expr) {
     }
     if( expr->type == AST_BINARY_OPERATION ) {
         sb_append(sb,"(");
-        switch (expr->binary_operation.opp_token.kind) {
+        switch (expr->binary_operation.opp) {
             case PLUS:
                 sb_append(sb,"+"); break;
             case DIVITION:
@@ -170,7 +440,7 @@ void print_expr_to_sb(StringBuilder* sb,AstExpr* expr) {
         sb_append(sb,")");
     } 
     if( expr->type == AST_FUNC_CALL ) {
-        sb_append(sb,"<Fn %s>{",expr->func_call.identifier.value);
+        sb_append(sb,"<Fn %s>{",expr->func_call.name);
         if( expr->func_call.args != NULL ){
             print_args_to_sb(sb,expr->func_call.args);
         }
@@ -2,29 +2,78 @@
 #define MY_STRING_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 
 typedef struct String {
     char* data;
     int len;
     int idx;
+    int mapped;
 } String;
 
 String String_readfile(FILE* file);
+String String_mapfile(const char* path);
+void String_unmap(String* string);
 char String_getc(String* string);
 void String_ungetc(String* string);
 
+//String Interner
+// Every distinct string is stored once, equal strings get the same pointer
+// so names can be compared with == instead of strcmp.
+
+typedef struct InternEntry {
+    char*    str;  // NULL = empty slot
+    int      len;
+    uint32_t hash;
+} InternEntry;
+
+typedef struct Interner {
+    InternEntry* entries;
+    size_t       capacity; // power of 2
+    size_t       count;
+    char*        block;    // storage for the strings
+    size_t       block_left;
+} Interner;
+
+Interner Interner_new();
+void Interner_free(Interner* interner);
+char* Interner_get(Interner* interner, const char* str, int len);
+char* Intern_n(const char* str, int len); // global interner
+char* Intern_n_cached(Interner* cache, const char* str, int len);
+char* Intern(const char* str);
+
+// hash of an interned string by its pointer, for open addressing tables keyed
+// by names. Inline since every scope and field lookup goes through it
+static inline uint32_t Intern_hash(const char* interned) {
+    return (uint32_t)((uintptr_t)interned * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+// 64 bit FNV-1a of data continuing from hash, start with FNV1A_INIT
+#define FNV1A_INIT 14695981039346656037ull
+uint64_t Hash_fnv1a(uint64_t hash, const void* data, size_t len);
+
 //String Builder
 
 typedef struct {
     char* buffer;
     size_t length;
     size_t capacity;
+    int fd; // -1 = in memory, otherwise sb_flush writes the buffer to it and empties it
+    size_t written; // bytes written to fd so far
 } StringBuilder;
 
 StringBuilder sb_new();
+StringBuilder sb_new_fd(int fd, size_t capacity);
+void sb_flush(StringBuilder* sb);
+void sb_write_through(StringBuilder* sb, const char* str, size_t len);
 void sb_reset(StringBuilder* sb);
 void sb_free(StringBuilder* sb);
+void sb_reserve(StringBuilder* sb, size_t extra);
 void sb_append(StringBuilder* sb, const char* fmt, ...);
+void sb_append_n(StringBuilder* sb, const char* str, size_t len);
+void sb_append_str(StringBuilder* sb, const char* str);
+void sb_append_char(StringBuilder* sb, char c);
 
 typedef struct AstExpr AstExpr;
 
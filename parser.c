@@ -8,46 +8,175 @@
 //
 //==================================
 
+#include <pthread.h>
+#include <unistd.h>
 #include "parser.h"
 #include "lexer.h"
+#include "arena.h"
+
+#include <stdarg.h>
 
 #define PANIC(fmt, ...) { \
-    printf(fmt "\n", ##__VA_ARGS__); \
-    exit(-1); \
+    Ast_error(fmt "\n", ##__VA_ARGS__); \
 }
     //*(int*)0=0; 
 #define ASSERT(expr, fmt, ...) { \
     if (!expr) { \
-        printf(fmt "\n", ##__VA_ARGS__); \
-        exit(-1); \
+        Ast_error(fmt "\n", ##__VA_ARGS__); \
     } \
 }
 
+_Thread_local jmp_buf* AST_ERROR_TRAP = NULL;
+_Thread_local char AST_ERROR_MESSAGE[AST_ERROR_MESSAGE_SIZE];
+
+_Noreturn void Ast_error(const char* fmt, ...) {
+    va_list args;
+    va_start(args,fmt);
+    if( AST_ERROR_TRAP == NULL ) {
+        vprintf(fmt,args);
+        exit(-1);
+    }
+    vsnprintf(AST_ERROR_MESSAGE,AST_ERROR_MESSAGE_SIZE,fmt,args);
+    va_end(args);
+    longjmp(*AST_ERROR_TRAP,1);
+}
+
+// every node and parse time Type of the current parse lives here,
+// each parse worker has its own arena that is merged into PROGRAM_ARENA
+_Thread_local Arena* PARSE_ARENA   = NULL;
+_Thread_local Arena* PROGRAM_ARENA = NULL; // lazy bodies are parsed into it
+_Thread_local Arena* BODY_ARENA    = NULL; // if set, lazy bodies parsed on this thread go here instead, see Ast_set_body_arena
+
+uint32_t AST_NODES_NUM = 0;
+uint32_t AST_EXPRS_NUM = 0; // ids handed out, AST_EXPR_IDS is only the end of the reserved blocks
+uint32_t AST_EXPR_IDS  = 0;
+
+// workers take expression ids from AST_EXPR_IDS in blocks instead of one by one
+#define AST_ID_BLOCK 1024
+_Thread_local uint32_t EXPR_ID_NEXT = 0;
+_Thread_local uint32_t EXPR_ID_END  = 0;
+_Thread_local uint32_t NODES_PARSED = 0; // added to AST_NODES_NUM by flush_nodes_num
+_Thread_local uint32_t EXPRS_PARSED = 0; // added to AST_EXPRS_NUM by flush_nodes_num
+
+static void flush_nodes_num() {
+    __atomic_fetch_add(&AST_NODES_NUM,NODES_PARSED,__ATOMIC_RELAXED);
+    __atomic_fetch_add(&AST_EXPRS_NUM,EXPRS_PARSED,__ATOMIC_RELAXED);
+    NODES_PARSED = 0;
+    EXPRS_PARSED = 0;
+}
+
+static uint32_t next_expr_id() {
+    if( EXPR_ID_NEXT == EXPR_ID_END ) {
+        EXPR_ID_NEXT = __atomic_fetch_add(&AST_EXPR_IDS,AST_ID_BLOCK,__ATOMIC_RELAXED);
+        EXPR_ID_END  = EXPR_ID_NEXT + AST_ID_BLOCK;
+    }
+    EXPRS_PARSED++;
+    return EXPR_ID_NEXT++;
+}
+
+// only expressions get an id, the side tables are dense over them
+static int Ast_is_expr(Ast_ExprType type) {
+    switch(type) {
+        case AST_BINARY_OPERATION:
+        case AST_UNARY_OPERATION:
+        case AST_FUNC_CALL:
+        case AST_NUMBER:
+        case AST_STRING:
+        case AST_IDENTIFIER:
+        case AST_EXPRESSION_STATEMENT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+AstExpr* Ast_new(Ast_ExprType type) {
+    AstExpr* node = (AstExpr*)Arena_alloc(PARSE_ARENA,sizeof(AstExpr));
+    node->type = type;
+    node->id = Ast_is_expr(type) ? next_expr_id() : AST_NO_ID;
+    switch( type ) {
+        case AST_DECLARATION:
+            node->declaration = (Declaretion*)Arena_alloc(PARSE_ARENA,sizeof(Declaretion));
+            break;
+        case AST_FUNCTION_DECLARATION:
+            node->function_declaration = (FunctionDeclaration*)Arena_alloc(PARSE_ARENA,sizeof(FunctionDeclaration));
+            break;
+        case AST_FOR_STATEMENT:
+            node->for_statement = (ForStatement*)Arena_alloc(PARSE_ARENA,sizeof(ForStatement));
+            break;
+        case AST_LAZY_BLOCK:
+            node->lazy_block = (LazyBlock*)Arena_alloc(PARSE_ARENA,sizeof(LazyBlock));
+            break;
+        default:
+            break;
+    }
+    NODES_PARSED++;
+    return node;
+}
+
+uint32_t Ast_nodes_num() {
+    return AST_NODES_NUM;
+}
+
+uint32_t Ast_exprs_num() {
+    return AST_EXPRS_NUM;
+}
+
+// Types of expressions, set by the analyzer and read by the backend.
+// Stored in fixed size pages so a pointer to a slot stays valid while the table grows.
+// Analyzer workers fill it concurrently, the page directory never moves and
+// a missing page is installed with a CAS.
+#define AST_TYPES_PAGE_SIZE 4096
+#define AST_TYPES_PAGES_MAX ((UINT32_MAX / AST_TYPES_PAGE_SIZE) + 1)
+
+TypeId* AST_TYPES_PAGES[AST_TYPES_PAGES_MAX];
+
+// slot for the type of node, TYPE_NONE until the analyzer sets it
+TypeId* Ast_type(AstExpr* node) {
+    ASSERT((node->id != AST_NO_ID),"%s %d: %d node has no type slot",__FILE__,__LINE__,node->type);
+    uint32_t page = node->id / AST_TYPES_PAGE_SIZE;
+    TypeId* types = __atomic_load_n(&AST_TYPES_PAGES[page],__ATOMIC_ACQUIRE);
+    if( types == NULL ) {
+        TypeId* new_types = (TypeId*)calloc(AST_TYPES_PAGE_SIZE,sizeof(TypeId));
+        ASSERT((new_types != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+        if( __atomic_compare_exchange_n(&AST_TYPES_PAGES[page],&types,new_types,0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE) ) {
+            types = new_types;
+        } else {
+            free(new_types);
+        }
+    }
+    return &types[node->id % AST_TYPES_PAGE_SIZE];
+}
+
+void Ast_free_types() {
+    uint32_t pages_num = (AST_EXPR_IDS + AST_TYPES_PAGE_SIZE - 1) / AST_TYPES_PAGE_SIZE;
+    for( uint32_t i = 0; i < pages_num; i++ ) {
+        free(AST_TYPES_PAGES[i]);
+        AST_TYPES_PAGES[i] = NULL;
+    }
+}
+
 AstExpr* AST_make_binary(AstExpr* left, Token opp, AstExpr* right) {
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-    node->type = AST_BINARY_OPERATION;
+    AstExpr* node = Ast_new(AST_BINARY_OPERATION);
     
-    node->binary_operation.opp_token    = opp;
+    node->binary_operation.opp          = opp.kind;
     node->binary_operation.left         = left;
     node->binary_operation.right        = right;
     return node;
 }
 AstExpr* Ast_make_number(Token number) {
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-    node->type = AST_NUMBER;
+    AstExpr* node = Ast_new(AST_NUMBER);
     node->number.token = number;
     return node;
 }
 AstExpr* Ast_make_ident(Token ident) {
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-    node->type = AST_IDENTIFIER;
+    AstExpr* node = Ast_new(AST_IDENTIFIER);
     node->identifier.token = ident;
     return node;
 }
 AstExpr* Ast_make_unary(Token opp, AstExpr* right) {
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-    node->type = AST_UNARY_OPERATION;
-    node->unary_operation.opp_token = opp;
+    AstExpr* node = Ast_new(AST_UNARY_OPERATION);
+    node->unary_operation.opp = opp.kind;
     node->unary_operation.right = right;
     return node;
 }
@@ -118,32 +247,35 @@ int is_opp(Token k) {
 
 // consumes the whole function call
 AstExpr* parse_args(Lexer* lexer) {
-    AstExpr* arg_node = (AstExpr*)malloc(sizeof(AstExpr));
-        arg_node ->type = AST_ARGUMENT;
-        arg_node ->argument.value = parse_expr_statement(lexer);
-
-    Token curr = Lexer_next(lexer);
-    switch(curr.kind) {
-        case CLOSE_PARENT:
-            arg_node->argument.next = NULL;
-            return arg_node;
-        case COMMA:
-            arg_node ->argument.next = parse_args(lexer);
-            return arg_node;
-        default:
-            PANIC("%s %d: expected COMMA or CLOSE_PARENT after expr in function call, got: %s:%s",__FILE__,__LINE__,format_enum(curr),curr.value);
+    AstExpr* head = NULL;
+    AstExpr** tail = &head;
+    while(1) {
+        AstExpr* arg_node = Ast_new(AST_ARGUMENT);
+            arg_node ->argument.value = parse_expr_statement(lexer);
+        *tail = arg_node;
+        tail = &arg_node->argument.next;
+
+        Token curr = Lexer_next(lexer);
+        switch(curr.kind) {
+            case CLOSE_PARENT:
+                arg_node->argument.next = NULL;
+                return head;
+            case COMMA:
+                continue;
+            default:
+                PANIC("%s %d: expected COMMA or CLOSE_PARENT after expr in function call, got: %s:%s",__FILE__,__LINE__,format_enum(curr),curr.value);
+        }
     }
 }
 
 AstExpr* parse_function_call(Lexer* lexer,Token ident) {
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-    node->type = AST_FUNC_CALL;
+    AstExpr* node = Ast_new(AST_FUNC_CALL);
     if( Lexer_peek(lexer).kind == CLOSE_PARENT) { // EMPTY FUNCTION CALL
         Lexer_next(lexer);
-        node->func_call.identifier = ident;
+        node->func_call.name = ident.value;
         node->func_call.args = NULL;
     } else {
-        node->func_call.identifier = ident;
+        node->func_call.name = ident.value;
         node->func_call.args = parse_args(lexer);
     }
     return node;
@@ -158,33 +290,32 @@ int parse_leaf(Lexer* lexer,AstExpr** left) {
         return 2;
     }
     Lexer_next(lexer);
-    AstExpr* leaf = (AstExpr*)malloc(sizeof(AstExpr));
+    if( t.kind == IDENT && Lexer_peek(lexer).kind == OPEN_PARENT ) {
+        //FunctionCall
+        Lexer_next(lexer); 
+        *left = parse_function_call(lexer,t);
+        return 1;
+    }
+    AstExpr* leaf;
 
     switch(t.kind) {
         case IDENT:
-            if( Lexer_peek(lexer).kind == OPEN_PARENT ) {
-                //FunctionCall
-                Lexer_next(lexer); 
-                *left = parse_function_call(lexer,t);
-                return 1;
-            } else {
-                leaf->type = AST_IDENTIFIER;
-                leaf->identifier.token = t;
-                *left = leaf;
-                return 1;
-            }
+            leaf = Ast_new(AST_IDENTIFIER);
+            leaf->identifier.token = t;
+            *left = leaf;
+            return 1;
         case NUMBER:
-            leaf->type = AST_NUMBER;
+            leaf = Ast_new(AST_NUMBER);
             leaf->number.token = t;
             *left = leaf;
             return 1;
         case STRING:
-            leaf->type = AST_STRING;
-            leaf->number.token = t;
+            leaf = Ast_new(AST_STRING);
+            leaf->string.token = t;
             *left = leaf;
             return 1;
         case OPEN_PARENT:
-            *left = leaf;
+            *left = NULL; // parse_expr parses the inner expr
             return 0;
         default:
             PANIC("%s %d: expected IDENT or NUMBER or STRING after %s, got: %s",
@@ -266,32 +397,31 @@ AstExpr* parse_expr(Lexer* lexer, int min_bp) {
 //  banana : int;
 //  banana := 5;     
 AstExpr* parse_decl(Lexer* lexer) {
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_DECLARATION;
+    AstExpr* node = Ast_new(AST_DECLARATION);
     Token ident = Lexer_next(lexer);
-        node->declaration.name = ident.value;
-        //node->declaration.type_info.star_number = 0;
+        node->declaration->name = ident.value;
+        //node->declaration->type_info.star_number = 0;
 
     Lexer_next(lexer); // Consume colon
     ASSERT( (Lexer_curr(lexer).kind == COLON ), "%s %d: Expected COLON after type in variable decl, got %s",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)));
 
     switch( Lexer_peek(lexer).kind ) {
         case ASSIGN:
-            node->declaration.type = NULL;
+            node->declaration->type = NULL;
             Lexer_next(lexer); // Consume Assign
-            node->declaration.value = parse_expr_statement(lexer);
+            node->declaration->value = parse_expr_statement(lexer);
             break;
         case STAR: // *int
         case SUBSCRIPT_OPEN: // []int
         case IDENT: // int
-            node->declaration.type = parse_type(lexer);
-            //node->declaration.type_info.type_name  = Lexer_next(lexer).value;
+            node->declaration->type = parse_type(lexer);
+            //node->declaration->type_info.type_name  = Lexer_next(lexer).value;
             if( Lexer_peek(lexer).kind == ASSIGN ) { // Value given
                 Lexer_next(lexer); // Consume Assign
-                node->declaration.value = parse_expr_statement(lexer);
+                node->declaration->value = parse_expr_statement(lexer);
             } else // No value given
             if( Lexer_peek(lexer).kind == SEMICOLON ) { 
-                node->declaration.value = parse_expr_statement(lexer); // empty expression
+                node->declaration->value = parse_expr_statement(lexer); // empty expression
             } else {
                 PANIC("%s %d: Expected ASSIGN or SEMICOLON after TYPE in declaration, got %s",__FILE__,__LINE__,format_enum(Lexer_peek(lexer)));
             }
@@ -304,32 +434,27 @@ AstExpr* parse_decl(Lexer* lexer) {
 }
 
 AstExpr* parse_arg_decl(Lexer* lexer) {
-    AstExpr* arg_node = (AstExpr*)malloc(sizeof(AstExpr));
-        arg_node->type = AST_ARGUMENT_DECLARATION;
-    /*
-        arg_node->argument_decl.type_info.star_number = 0;
-    while( Lexer_peek(lexer).kind == STAR) {
-        arg_node->argument_decl.type_info.star_number += 1;
-        Lexer_next(lexer);
-    }
-    */
-    arg_node->argument_decl.type = parse_type(lexer);
+    AstExpr* head = NULL;
+    AstExpr** tail = &head;
+    while(1) {
+        AstExpr* arg_node = Ast_new(AST_ARGUMENT_DECLARATION);
+        arg_node->argument_decl.type = parse_type(lexer);
 
+            arg_node->argument_decl.ident = Lexer_next(lexer).value;
+        ASSERT( Lexer_curr(lexer).kind == IDENT ,"%s %d: expected TYPE for arg decl, got %s",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)) );
+        *tail = arg_node;
+        tail = &arg_node->argument_decl.next;
 
-    //ASSERT( is_type(arg_node->argument_decl.type) ,"%s %d: expected TYPE for arg decl, got %s",__FILE__,__LINE__,format_enum(arg_node->argument_decl.type) );
-        arg_node->argument_decl.ident = Lexer_next(lexer).value;
-    ASSERT( Lexer_curr(lexer).kind == IDENT ,"%s %d: expected TYPE for arg decl, got %s",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)) );
-
-    Token next = Lexer_next(lexer);
-    switch(next.kind) {
-        case CLOSE_PARENT:
-            arg_node->argument_decl.next = NULL;
-            return arg_node;
-        case COMMA:
-            arg_node ->argument_decl.next = parse_arg_decl(lexer);
-            return arg_node;
-        default:
-            PANIC("%s %d: expected COMMA or CLOSE_PARENT after ARG_DECL in FUNC_DECL, got: %s",__FILE__,__LINE__,format_enum(next));
+        Token next = Lexer_next(lexer);
+        switch(next.kind) {
+            case CLOSE_PARENT:
+                arg_node->argument_decl.next = NULL;
+                return head;
+            case COMMA:
+                continue;
+            default:
+                PANIC("%s %d: expected COMMA or CLOSE_PARENT after ARG_DECL in FUNC_DECL, got: %s",__FILE__,__LINE__,format_enum(next));
+        }
     }
 }
 
@@ -340,82 +465,144 @@ AstExpr* parse_block_statement(Lexer* lexer) {
     Lexer_next(lexer); // CONSUME OPEN_CURRLY_PARENT 
     ASSERT( (Lexer_curr(lexer).kind == OPEN_CURRLY_PARENT) ,"%s %d: expected OPEN_CURRLY_PARENT",__FILE__,__LINE__);
 
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_BLOCK_STATEMENT;
+    AstExpr* node = Ast_new(AST_BLOCK_STATEMENT);
         node->block_statement.statements = parse_statements(lexer);
     Lexer_next(lexer); // CONSUME CLOSE_CURRLY_PARENT
     ASSERT( (Lexer_curr(lexer).kind == CLOSE_CURRLY_PARENT) ,"%s %d: expected CLOSE_CURRLY_PARENT, got %s, lexer idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
     return node;
 }
 
+// expects Lexer_peek() == OPEN_CURRLY_PARENT
+// only matches the braces, after call Lexer_curr() == the matching CLOSE_CURRLY_PARENT
+AstExpr* parse_lazy_block(Lexer* lexer) {
+    AstExpr* node = Ast_new(AST_LAZY_BLOCK);
+        node->lazy_block->tokens  = lexer->tokens;
+        node->lazy_block->start   = lexer->idx + 1;
+        node->lazy_block->arena   = PROGRAM_ARENA;
+        node->lazy_block->reached = 1;
+
+    int depth = 0;
+    for( int i = node->lazy_block->start; i < lexer->tokens_len; i++ ) {
+        switch( lexer->tokens[i].kind ) {
+            case OPEN_CURRLY_PARENT:
+                depth++;
+                break;
+            case CLOSE_CURRLY_PARENT:
+                depth--;
+                if( depth == 0 ) {
+                    node->lazy_block->end = i;
+                    lexer->idx = i;
+                    return node;
+                }
+                break;
+            case EOF_TOKEN:
+                i = lexer->tokens_len;
+                break;
+        }
+    }
+    PANIC("%s %d: expected '}' to close the function body opened at token %d",__FILE__,__LINE__,node->lazy_block->start);
+}
+
+// parses the body of func on first use
+AstExpr* Ast_func_body(AstExpr* func) {
+    AstExpr* lazy = func->function_declaration->body;
+    if( lazy->lazy_block->block == NULL ) {
+        Lexer lexer = Lexer_new(lazy->lazy_block->tokens,lazy->lazy_block->end + 1);
+            lexer.idx = lazy->lazy_block->start - 1;
+        Arena* prev_arena = PARSE_ARENA;
+        PARSE_ARENA = BODY_ARENA != NULL ? BODY_ARENA : lazy->lazy_block->arena;
+        lazy->lazy_block->block = parse_block_statement(&lexer);
+        PARSE_ARENA = prev_arena;
+        flush_nodes_num();
+        ASSERT( (lexer.idx == lazy->lazy_block->end) , "%s %d: function body of %s ended at token %d, expected %d",__FILE__,__LINE__,func->function_declaration->name,lexer.idx,lazy->lazy_block->end);
+    }
+    return lazy->lazy_block->block;
+}
+
+// Lazy bodies parsed by the calling thread are allocated from arena, NULL
+// restores the default. Threads that parse bodies concurrently need their own
+// arena, merge it into Ast_program_arena(func) once they are done.
+void Ast_set_body_arena(Arena* arena) {
+    BODY_ARENA = arena;
+}
+
+Arena* Ast_program_arena(AstExpr* func) {
+    return func->function_declaration->body->lazy_block->arena;
+}
+
+int Ast_func_reached(AstExpr* func) {
+    return func->function_declaration->body->lazy_block->reached;
+}
+
+int Ast_func_cached(AstExpr* func) {
+    return func->function_declaration->body->lazy_block->cached;
+}
+
 AstExpr* parse_func_decl(Lexer* lexer) {
     Lexer_next(lexer); // CONSUME FN 
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_FUNCTION_DECLARATION;
-        //node->function_declaration.return_type_info.star_number = 0;
+    AstExpr* node = Ast_new(AST_FUNCTION_DECLARATION);
+        //node->function_declaration->return_type_info.star_number = 0;
 
     Token ident = Lexer_next(lexer);
-        node->function_declaration.name = ident.value;
+        node->function_declaration->name = ident.value;
     ASSERT( (Lexer_curr(lexer).kind == IDENT) , "%s %d: expected fn IDENT, got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
 
     Lexer_next(lexer); // CONSUME OPEN_PARENT
     ASSERT( (Lexer_curr(lexer).kind == OPEN_PARENT) , "%s %d: expected OPEN_PARENT after fn IDENT, got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
 
     if( Lexer_peek(lexer).kind == CLOSE_PARENT) { // NO ARGS
-        node->function_declaration.args = NULL;
+        node->function_declaration->args = NULL;
         Lexer_next(lexer); // CONSUME CLOSE_PARENT
     } else {
-        node->function_declaration.args = parse_arg_decl(lexer);
+        node->function_declaration->args = parse_arg_decl(lexer);
         ASSERT( (Lexer_curr(lexer).kind == CLOSE_PARENT) , "%s %d: expected CLOSE_PARENT, got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
     }
 
     if( Lexer_peek(lexer).kind == ARROW ) {
         Lexer_next(lexer);
-        node->function_declaration.return_type = parse_type(lexer);
+        node->function_declaration->return_type = parse_type(lexer);
         /*
         while( Lexer_peek(lexer).kind == STAR ) {
-            node->function_declaration.return_type_info.star_number += 1;
+            node->function_declaration->return_type_info.star_number += 1;
             Lexer_next(lexer);
         }
         Token return_type_name = Lexer_next(lexer);
         //ASSERT( (is_type(return_type)) , "%s %d: expected type name after '->', got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
-        node->function_declaration.return_type_info.type_name = return_type_name.value;
+        node->function_declaration->return_type_info.type_name = return_type_name.value;
         */
 
     } else {
-        Type* return_type = (Type*)malloc(sizeof(Type));
-        *return_type = (Type){.type_kind=UNKNOWN_TYPE, .type_name = "void" };
-        node->function_declaration.return_type = return_type;
+        Type* return_type = (Type*)Arena_alloc(PARSE_ARENA,sizeof(Type));
+        *return_type = (Type){.type_kind=UNKNOWN_TYPE, .type_name = Intern("void") };
+        node->function_declaration->return_type = return_type;
     }
     ASSERT( (Lexer_peek(lexer).kind == OPEN_CURRLY_PARENT) , "%s %d: expected '{', got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
-    node->function_declaration.body = parse_block_statement(lexer);
+    node->function_declaration->body = parse_lazy_block(lexer);
     ASSERT( (Lexer_curr(lexer).kind == CLOSE_CURRLY_PARENT) , "%s %d: expected '}' after if_statement body, got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
     return node;
 }
 
 AstExpr* parse_for(Lexer* lexer) {
     Lexer_next(lexer); // CONSUME FOR
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_FOR_STATEMENT;
+    AstExpr* node = Ast_new(AST_FOR_STATEMENT);
 
-    node->for_statement.initial = parse_statement(lexer);
+    node->for_statement->initial = parse_statement(lexer);
     ASSERT( (Lexer_curr(lexer).kind == SEMICOLON ), "%s %d: Expected SEMICOLON after FOR init expr, got %s",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)));
 
-    node->for_statement.condition = parse_statement(lexer);
+    node->for_statement->condition = parse_statement(lexer);
     ASSERT( (Lexer_curr(lexer).kind == SEMICOLON ), "%s %d: Expected SEMICOLON after FOR condition expr",__FILE__,__LINE__);
 
-    node->for_statement.iteration = parse_statement(lexer);
+    node->for_statement->iteration = parse_statement(lexer);
 
     ASSERT( (Lexer_peek(lexer).kind == OPEN_CURRLY_PARENT) , "%s %d: expected '{', got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
-    node->for_statement.body = parse_block_statement(lexer);
+    node->for_statement->body = parse_block_statement(lexer);
     ASSERT( (Lexer_curr(lexer).kind == CLOSE_CURRLY_PARENT) , "%s %d: expected '}' after if_statement body, got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
     return node;
 }
 
 AstExpr* parse_while(Lexer* lexer) {
     Lexer_next(lexer); // CONSUME WHILE
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_WHILE_STATEMENT;
+    AstExpr* node = Ast_new(AST_WHILE_STATEMENT);
         node->while_statement.condition = parse_statement(lexer);
 
     ASSERT( (Lexer_peek(lexer).kind == OPEN_CURRLY_PARENT) , "%s %d: expected '{', got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
@@ -425,16 +612,14 @@ AstExpr* parse_while(Lexer* lexer) {
 }
 AstExpr* parse_return(Lexer* lexer) {
     Lexer_next(lexer); // CONSUME RETURN
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_RETURN_STATEMENT;
+    AstExpr* node = Ast_new(AST_RETURN_STATEMENT);
         node->return_statement.expression = parse_statement(lexer);
     ASSERT( (Lexer_curr(lexer).kind == SEMICOLON ), "%s %d: Expected SEMICOLON after return expr , got %s",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)));
     return node;
 }
 AstExpr* parse_if(Lexer* lexer) {
     Lexer_next(lexer); // CONSUME IF
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_IF_STATEMENT;
+    AstExpr* node = Ast_new(AST_IF_STATEMENT);
         node->if_statement.condition = parse_expr_statement(lexer);
 
     ASSERT( (Lexer_peek(lexer).kind == OPEN_CURRLY_PARENT) , "%s %d: expected '{', got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_peek(lexer)),lexer->idx);
@@ -445,8 +630,7 @@ AstExpr* parse_if(Lexer* lexer) {
 
 /// Consumes ending SEMICOLON
 AstExpr* parse_expr_statement(Lexer* lexer) {
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_EXPRESSION_STATEMENT;
+    AstExpr* node = Ast_new(AST_EXPRESSION_STATEMENT);
         node->expression_statement.value = parse_expr(lexer,0);
     Token next = Lexer_peek(lexer);
     if( next.kind == SEMICOLON ) {
@@ -458,8 +642,7 @@ AstExpr* parse_expr_statement(Lexer* lexer) {
 }
 AstExpr* parse_struct_decl(Lexer* lexer) {
     Lexer_next(lexer); // Consume STRUCT
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_STRUCT_DECLARATION;
+    AstExpr* node = Ast_new(AST_STRUCT_DECLARATION);
         node->struct_declaration.name = Lexer_next(lexer).value;
     ASSERT( (Lexer_curr(lexer).kind == IDENT), "%s %d: Expected IDENT after STRUCT keyword",__FILE__,__LINE__);
         node->struct_declaration.body = parse_block_statement(lexer);
@@ -467,8 +650,7 @@ AstExpr* parse_struct_decl(Lexer* lexer) {
 }
 AstExpr* parse_extern_statement(Lexer* lexer) {
     Lexer_next(lexer); // Consume EXTERN
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
-        node->type = AST_EXTERN_STATEMENT;
+    AstExpr* node = Ast_new(AST_EXTERN_STATEMENT);
         node->extern_statement.body = parse_statement(lexer);
     return node;
 }
@@ -481,7 +663,7 @@ AstExpr* parse_statement(Lexer* lexer) {
         return NULL;
     }
 
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
+    AstExpr* node;
 
     switch( next.kind ) {
         case IF:
@@ -490,7 +672,7 @@ AstExpr* parse_statement(Lexer* lexer) {
             return node;
         case FOR:
             node = parse_for(lexer);
-            node->for_statement.next = NULL;
+            node->for_statement->next = NULL;
             return node;
         case WHILE:
             node = parse_while(lexer);
@@ -507,7 +689,7 @@ AstExpr* parse_statement(Lexer* lexer) {
             return node;
         case FN:
             node = parse_func_decl(lexer);
-            node->function_declaration.next = NULL;
+            node->function_declaration->next = NULL;
             return node;
         case EXTERN:
             node = parse_extern_statement(lexer);
@@ -523,7 +705,7 @@ AstExpr* parse_statement(Lexer* lexer) {
 
     if( Lexer_peek_n(lexer,2).kind == COLON ) {
         node = parse_decl(lexer);
-        node->declaration.next = NULL;
+        node->declaration->next = NULL;
         return node;
     } else { // EXPR
         node = parse_expr_statement(lexer);
@@ -532,66 +714,352 @@ AstExpr* parse_statement(Lexer* lexer) {
     }
 }
 
+// parses one statement of a statement list, *next_field is set to its next field
 // expects Lexer_next() == OPEN_CURRLY_PARENT | {KEYWORD} | {DECL}
-// consumes whole statement with ; and } 
-AstExpr* parse_statements(Lexer* lexer) {
+AstExpr* parse_list_statement(Lexer* lexer, AstExpr*** next_field) {
     Token next = Lexer_peek(lexer);
-    if( next.kind == EOF_TOKEN || next.kind == CLOSE_CURRLY_PARENT ) 
-        return NULL;
-
-    AstExpr* node = (AstExpr*)malloc(sizeof(AstExpr));
+    AstExpr* node;
+    AstExpr** node_next;
 
     switch( next.kind ) {
         case IF:
             node = parse_if(lexer);
-            node->if_statement.next = parse_statements(lexer);
-            return node;
+            node_next = &node->if_statement.next;
+            break;
         case FOR:
             node = parse_for(lexer);
-            node->for_statement.next = parse_statements(lexer);
-            return node;
+            node_next = &node->for_statement->next;
+            break;
         case WHILE:
             node = parse_while(lexer);
-            node->while_statement.next = parse_statements(lexer);
-            return node;
+            node_next = &node->while_statement.next;
+            break;
         case RETURN:
             node = parse_return(lexer);
-            node->return_statement.next = parse_statements(lexer);
-            return node;
+            node_next = &node->return_statement.next;
+            break;
         case OPEN_CURRLY_PARENT:
             node = parse_block_statement(lexer);
             ASSERT( (Lexer_curr(lexer).kind == CLOSE_CURRLY_PARENT) , "%s %d: expected '}' after block statement, got %s, idx: %d",__FILE__,__LINE__,format_enum(Lexer_curr(lexer)),lexer->idx);
-            node->block_statement.next = parse_statements(lexer);
-            return node;
+            node_next = &node->block_statement.next;
+            break;
         case FN:
             node = parse_func_decl(lexer);
-            node->function_declaration.next = parse_statements(lexer);
-            return node;
+            node_next = &node->function_declaration->next;
+            break;
         case EXTERN:
             node = parse_extern_statement(lexer);
-            node->extern_statement.next = parse_statements(lexer);
-            return node;
+            node_next = &node->extern_statement.next;
+            break;
         case STRUCT:
             node = parse_struct_decl(lexer);
-            node->struct_declaration.next = parse_statements(lexer);
-            return node;
+            node_next = &node->struct_declaration.next;
+            break;
+        default:
+            // expected identifier than if ':' its a declaration if not an expression;
+            if( Lexer_peek_n(lexer,2).kind == COLON ) {
+                node = parse_decl(lexer);
+                node_next = &node->declaration->next;
+            } else { // EXPR
+                node = parse_expr_statement(lexer);
+                node_next = &node->expression_statement.next;
+            }
     }
-    // expected identifier than if ':' its a declaration if not an expression;
-    //ASSERT( (next.kind == IDENT || next.kind == OPEN_PARENT || is_unary(next)) ,"expected KEYWORD,UNARY_OPP,OPEN_CURRLY_PARENT, OPEN_PARENT or IDENT got %s, idx: %d",format_enum(next),lexer->idx);
+    *node_next = NULL;
+    *next_field = node_next;
+    return node;
+}
 
-    if( Lexer_peek_n(lexer,2).kind == COLON ) {
-        node = parse_decl(lexer);
-        node->declaration.next = parse_statements(lexer);
-        return node;
-    } else { // EXPR
-        node = parse_expr_statement(lexer);
-        node->expression_statement.next = parse_statements(lexer);
-        return node;
+// expects Lexer_next() == OPEN_CURRLY_PARENT | {KEYWORD} | {DECL}
+// consumes whole statement with ; and } 
+// builds the list in a loop, appending to the tail, so the C stack
+// doesnt grow with the number of statements
+AstExpr* parse_statements(Lexer* lexer) {
+    AstExpr* head = NULL;
+    AstExpr** tail = &head;
+
+    while(1) {
+        Token next = Lexer_peek(lexer);
+        if( next.kind == EOF_TOKEN || next.kind == CLOSE_CURRLY_PARENT ) 
+            return head;
+
+        AstExpr** node_next;
+        *tail = parse_list_statement(lexer,&node_next);
+        tail = node_next;
+    }
+}
+
+AstExpr* Ast_next(AstExpr* stm) {
+    switch( stm->type ) {
+        case AST_FUNCTION_DECLARATION: return stm->function_declaration->next;
+        case AST_BLOCK_STATEMENT:      return stm->block_statement.next;
+        case AST_DECLARATION:          return stm->declaration->next;
+        case AST_IF_STATEMENT:         return stm->if_statement.next;
+        case AST_FOR_STATEMENT:        return stm->for_statement->next;
+        case AST_WHILE_STATEMENT:      return stm->while_statement.next;
+        case AST_RETURN_STATEMENT:     return stm->return_statement.next;
+        case AST_EXPRESSION_STATEMENT: return stm->expression_statement.next;
+        case AST_STRUCT_DECLARATION:   return stm->struct_declaration.next;
+        case AST_EXTERN_STATEMENT:     return stm->extern_statement.next;
+        default:
+            PANIC("%s %d: not a statement: %d",__FILE__,__LINE__,stm->type);
+    }
+}
+
+static size_t func_slot(char* name, size_t cap) {
+    return Intern_hash(name) & (cap - 1);
+}
+
+// Marks the global functions that can be called from main, starting from main
+// and following every `ident(` in the reached bodies. Only the tokens are scanned
+// so unreached bodies are never parsed. A name shadowed by a local only
+// makes the set bigger. Without main every function counts as reached.
+void Ast_mark_reachable(AstExpr* program) {
+    char* main_ident = Intern("main");
+
+    // name -> function declaration, names are interned so the pointer is the key
+    size_t funcs_num = 0;
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type == AST_FUNCTION_DECLARATION ) {
+            funcs_num++;
+        }
+    }
+    size_t funcs_cap = 16;
+    while( funcs_cap < funcs_num * 2 ) {
+        funcs_cap *= 2;
+    }
+    AstExpr** funcs = (AstExpr**)calloc(funcs_cap,sizeof(AstExpr*));
+    ASSERT((funcs != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    AstExpr* main_func = NULL;
+    for( AstExpr* stm = program; stm != NULL; stm = Ast_next(stm) ) {
+        if( stm->type != AST_FUNCTION_DECLARATION ) {
+            continue;
+        }
+        char* name = stm->function_declaration->name;
+        size_t slot = func_slot(name,funcs_cap);
+        while( funcs[slot] != NULL ) {
+            slot = (slot + 1) & (funcs_cap - 1);
+        }
+        funcs[slot] = stm;
+        if( name == main_ident ) {
+            main_func = stm;
+        }
+    }
+    if( main_func == NULL ) {
+        free(funcs);
+        return;
+    }
+    for( size_t i = 0; i < funcs_cap; i++ ) {
+        if( funcs[i] != NULL ) {
+            funcs[i]->function_declaration->body->lazy_block->reached = 0;
+        }
+    }
+
+    int       work_cap = 16;
+    int       work_len = 0;
+    AstExpr** work     = (AstExpr**)malloc(sizeof(AstExpr*)*work_cap);
+    ASSERT((work != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    main_func->function_declaration->body->lazy_block->reached = 1;
+    work[work_len++] = main_func;
+
+    while( work_len > 0 ) {
+        AstExpr* lazy = work[--work_len]->function_declaration->body;
+        Token* tokens = lazy->lazy_block->tokens;
+        for( int i = lazy->lazy_block->start; i < lazy->lazy_block->end; i++ ) {
+            if( tokens[i].kind != IDENT || tokens[i+1].kind != OPEN_PARENT ) {
+                continue;
+            }
+            size_t slot = func_slot(tokens[i].value,funcs_cap);
+            for( ; funcs[slot] != NULL; slot = (slot + 1) & (funcs_cap - 1) ) {
+                AstExpr* callee = funcs[slot];
+                if( callee->function_declaration->name != tokens[i].value ||
+                    callee->function_declaration->body->lazy_block->reached ) {
+                    continue;
+                }
+                callee->function_declaration->body->lazy_block->reached = 1;
+                if( work_len == work_cap ) {
+                    work_cap *= 2;
+                    work = (AstExpr**)realloc(work,sizeof(AstExpr*)*work_cap);
+                    ASSERT((work != NULL),"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+                }
+                work[work_len++] = callee;
+            }
+        }
+    }
+    free(work);
+    free(funcs);
+}
+
+#define PARSE_MIN_CHUNK_TOKENS (32*1024)
+#define PARSE_MAX_WORKERS      64
+
+// Top level items in tokens[start..end), parsed by one worker
+typedef struct ParseChunk {
+    Token*    tokens;
+    int       tokens_len;
+    int       start;
+    int       end;
+    Arena     arena;
+    Arena*    program_arena;
+    AstExpr*  head;
+    AstExpr** tail; // next field of the last item
+} ParseChunk;
+
+void* parse_chunk(void* arg) {
+    ParseChunk* chunk = (ParseChunk*)arg;
+    PARSE_ARENA   = &chunk->arena;
+    PROGRAM_ARENA = chunk->program_arena;
+
+    Lexer lexer = Lexer_new(chunk->tokens,chunk->tokens_len);
+        lexer.idx = chunk->start - 1;
+    chunk->head = NULL;
+    chunk->tail = &chunk->head;
+    while( lexer.idx + 1 < chunk->end ) {
+        AstExpr** node_next;
+        *chunk->tail = parse_list_statement(&lexer,&node_next);
+        chunk->tail = node_next;
+    }
+    ASSERT( (lexer.idx + 1 == chunk->end) , "%s %d: top level item parsed past its end, idx: %d, end: %d",__FILE__,__LINE__,lexer.idx,chunk->end);
+    flush_nodes_num();
+    PARSE_ARENA   = NULL;
+    PROGRAM_ARENA = NULL;
+    return NULL;
+}
+
+// Returns the index one past the top level item starting at tokens[i], or -1
+// if the braces dont match so the serial parser can report the error.
+// fn/struct/if/while/for/'{' items end with the '}' that closes their first
+// top level block (for skips the ';' in its header), extern ends like the
+// item it wraps and everything else ends with a ';' at depth 0.
+int top_level_item_end(Token* tokens, int tokens_len, int i) {
+    int ends_with_block;
+    switch( tokens[i].kind ) {
+        case FN:
+        case STRUCT:
+        case IF:
+        case WHILE:
+        case FOR:
+        case OPEN_CURRLY_PARENT:
+            ends_with_block = 1;
+            break;
+        case EXTERN:
+            ends_with_block = i + 1 < tokens_len && (tokens[i+1].kind == OPEN_CURRLY_PARENT || tokens[i+1].kind == FN);
+            break;
+        default:
+            ends_with_block = 0;
+    }
+    int depth = 0;
+    for( ; i < tokens_len; i++ ) {
+        switch( tokens[i].kind ) {
+            case OPEN_CURRLY_PARENT:
+                depth++;
+                break;
+            case CLOSE_CURRLY_PARENT:
+                depth--;
+                if( depth < 0 ) {
+                    return -1;
+                }
+                if( depth == 0 && ends_with_block ) {
+                    return i + 1;
+                }
+                break;
+            case SEMICOLON:
+                if( depth == 0 && !ends_with_block ) {
+                    return i + 1;
+                }
+                break;
+            case EOF_TOKEN:
+                return -1;
+        }
+    }
+    return -1;
+}
+
+// Splits the top level into at most max_chunks chunks of whole items,
+// ends[i] is the token index one past chunk i, the last chunk ends at the
+// first EOF_TOKEN. Returns the number of chunks or 0 if the items couldnt be found.
+static int split_top_level(Lexer* lexer, int max_chunks, int* ends) {
+    Token* tokens = lexer->tokens;
+    int chunk_size = lexer->tokens_len / max_chunks + 1;
+    int chunks = 0;
+    int i = 0;
+    while( tokens[i].kind != EOF_TOKEN ) {
+        int end = top_level_item_end(tokens,lexer->tokens_len,i);
+        if( end < 0 ) {
+            return 0;
+        }
+        i = end;
+        if( i >= (chunks + 1) * chunk_size && chunks < max_chunks - 1 ) {
+            ends[chunks++] = i;
+        }
     }
+    if( chunks == 0 || ends[chunks-1] != i ) {
+        ends[chunks++] = i;
+    }
+    return chunks;
 }
 
-AstExpr* parse_program(Lexer* lexer) {
-    AstExpr* ast = parse_statements(lexer);
+// the tree is allocated from arena and released with Arena_free(arena)
+// function bodies are parsed on demand, see Ast_func_body.
+// Big inputs are split into chunks of top level items that are parsed on
+// worker threads and linked back in source order.
+AstExpr* parse_program(Lexer* lexer, Arena* arena) {
+    int max_chunks = sysconf(_SC_NPROCESSORS_ONLN);
+    if( max_chunks > PARSE_MAX_WORKERS ) {
+        max_chunks = PARSE_MAX_WORKERS;
+    }
+    if( max_chunks > lexer->tokens_len / PARSE_MIN_CHUNK_TOKENS ) {
+        max_chunks = lexer->tokens_len / PARSE_MIN_CHUNK_TOKENS;
+    }
+    int ends[PARSE_MAX_WORKERS];
+    int chunks_num = 0;
+    if( max_chunks > 1 && lexer->idx == -1 ) {
+        chunks_num = split_top_level(lexer,max_chunks,ends);
+    }
+
+    AstExpr* ast;
+    if( chunks_num < 2 ) {
+        PARSE_ARENA   = arena;
+        PROGRAM_ARENA = arena;
+        ast = parse_statements(lexer);
+        flush_nodes_num();
+        PARSE_ARENA   = NULL;
+        PROGRAM_ARENA = NULL;
+    } else {
+        ParseChunk chunks[PARSE_MAX_WORKERS];
+        pthread_t  threads[PARSE_MAX_WORKERS];
+        for( int i = 0; i < chunks_num; i++ ) {
+            chunks[i] = (ParseChunk){
+                .tokens        = lexer->tokens,
+                .tokens_len    = lexer->tokens_len,
+                .start         = i == 0 ? 0 : ends[i-1],
+                .end           = ends[i],
+                .arena         = Arena_new(),
+                .program_arena = arena,
+            };
+        }
+        for( int i = 1; i < chunks_num; i++ ) {
+            if( pthread_create(&threads[i],NULL,parse_chunk,&chunks[i]) != 0 ) {
+                PANIC("%s %d: Failed to create parser thread",__FILE__,__LINE__);
+            }
+        }
+        parse_chunk(&chunks[0]);
+        for( int i = 1; i < chunks_num; i++ ) {
+            pthread_join(threads[i],NULL);
+        }
+
+        AstExpr** tail = &ast;
+        for( int i = 0; i < chunks_num; i++ ) {
+            *tail = chunks[i].head;
+            if( chunks[i].head != NULL ) {
+                tail = chunks[i].tail;
+            }
+            Arena_merge(arena,&chunks[i].arena);
+        }
+        *tail = NULL;
+        lexer->idx = ends[chunks_num-1] - 1;
+    }
+    Ast_mark_reachable(ast);
     return ast;
 }
 
@@ -601,7 +1069,7 @@ AstExpr* parse_program(Lexer* lexer) {
 // ARRAY_TYPE,
 // UNKNOWN_TYPE,
 Type* parse_type(Lexer* lexer) {
-    Type* type = (Type*)malloc(sizeof(Type));
+    Type* type = (Type*)Arena_alloc(PARSE_ARENA,sizeof(Type));
     Token next = Lexer_next(lexer);
     switch( next.kind ) {
         case STAR:
@@ -3,6 +3,8 @@
 
 #include "lexer.h"
 #include "types.h"
+#include "arena.h"
+#include <setjmp.h>
 
 typedef enum {
     AST_BINARY_OPERATION,   
@@ -24,6 +26,7 @@ typedef enum {
 
     AST_STRUCT_DECLARATION,
     AST_EXTERN_STATEMENT,
+    AST_LAZY_BLOCK,
 } Ast_ExprType;
 
 typedef struct TypeInfo {
@@ -32,23 +35,85 @@ typedef struct TypeInfo {
     char* type_name;
 } TypeInfo;
 
+#define AST_NO_ID UINT32_MAX
+
+// What an identifier refers to, filled in by the analyzer so later phases
+// never have to look a name up again
+typedef enum BindingKind {
+    BINDING_NONE,     // not analyzed
+    BINDING_LOCAL,    // index = slot in the function frame, args first. Slots are reused by sibling blocks
+    BINDING_GLOBAL,   // index = global var number
+    BINDING_FUNCTION, // index = function id, in declaration order
+    BINDING_FIELD,    // right side of a '.', index = field number in the struct
+    BINDING_LENGTH,   // right side of a '.' on an array
+} BindingKind;
+
+typedef struct Binding {
+    BindingKind kind;
+    uint32_t index;
+} Binding;
+
+// Variants wider than the union are rare (one per declaration, function or
+// for loop), Ast_new allocates them from the arena next to the node and the
+// node only holds the pointer.
+struct AstExpr;
+
+typedef struct Declaretion {
+    Type* type;
+    char* name;         
+    struct AstExpr* value; // AST_EXPRESSION_STATEMENT // CAN BE NULL
+    struct AstExpr* next; // CAN BE NULL
+} Declaretion;
+
+typedef struct FunctionDeclaration {
+    Type* return_type;
+    char* name;          
+    struct AstExpr* args;      
+    struct AstExpr* body; // LazyBlock, use Ast_func_body()
+    struct AstExpr* next; // CAN BE NULL
+} FunctionDeclaration;
+
+typedef struct ForStatement {
+    struct AstExpr* initial;
+    struct AstExpr* condition;
+    struct AstExpr* iteration;
+    struct AstExpr* body; // BlockStatment
+    struct AstExpr* next;
+} ForStatement;
+
+// Function body that is parsed the first time its needed.
+// tokens[start] == '{' and tokens[end] == its matching '}'
+typedef struct LazyBlock {
+    Token* tokens;
+    int start;
+    int end;
+    struct AstExpr* block; // BlockStatment, NULL until parsed
+    Arena* arena;
+    uint8_t reached; // reachable from main, see Ast_mark_reachable
+    uint8_t cached;  // C of the function is reused from the incremental cache, the body is never parsed
+} LazyBlock;
+
+// Nodes dont store analyzer results, the type of an expression is kept in
+// a side table indexed by id (see Ast_type) so every node stays as small
+// as its biggest common syntactic variant, 32 bytes.
 typedef struct AstExpr {
     Ast_ExprType type;            
+    uint32_t id; // expressions only, index into the side tables. AST_NO_ID otherwise
     union {
         struct BinaryOperation {
-            Type type;
-            Token opp_token;        
+            TokenKind opp;
             struct AstExpr* left; 
             struct AstExpr* right; 
         } binary_operation;
         struct UnaryOperation {
             //Type* type;
-            Token opp_token;        
+            TokenKind opp;
             struct AstExpr* right; 
         } unary_operation; // TODO implement unary in parser
         struct FuncCall {
-            Token identifier;
+            char* name; // interned
             struct AstExpr* args; // argument*
+            Binding binding;
         } func_call;   
         struct FuncArg {
             struct AstExpr* value; // expression_statement*
@@ -66,35 +131,17 @@ typedef struct AstExpr {
             Token token;   
         } string;     
         struct Identifier {
-            Type type;
             Token token;
+            Binding binding; // fits in the union padding, unlike the type it doesnt need a side table
         } identifier;
-        struct Declaretion {
-            Type* type;
-            char* name;         
-            struct AstExpr* value; // AST_EXPRESSION_STATEMENT // CAN BE NULL
-            struct AstExpr* next; // CAN BE NULL
-        } declaration;
-        struct FunctionDeclaration {
-            Type* return_type;
-            char* name;          
-            struct AstExpr* args;      
-            struct AstExpr* body; // BlockStatment
-            struct AstExpr* next; // CAN BE NULL
-        } function_declaration;   
+        struct Declaretion* declaration;
+        struct FunctionDeclaration* function_declaration;
         struct IfStatement {
             struct AstExpr* condition;
             struct AstExpr* body; // BlockStatment
-            struct AstExpr* else_block; // NOT IMPLEMENTED
             struct AstExpr* next;
         } if_statement;
-        struct ForStatement {
-            struct AstExpr* initial;
-            struct AstExpr* condition;
-            struct AstExpr* iteration;
-            struct AstExpr* body; // BlockStatment
-            struct AstExpr* next;
-        } for_statement;
+        struct ForStatement* for_statement;
         struct WhileStatement {
             struct AstExpr* condition;
             struct AstExpr* body; // BlockStatment
@@ -109,7 +156,6 @@ typedef struct AstExpr {
             struct AstExpr* next; // Can be NULL
         } block_statement;
         struct ExpressionStatement {
-            Type type;
             struct AstExpr* value; // Can be NULL
             struct AstExpr* next; // Can be NULL
         } expression_statement;
@@ -118,6 +164,7 @@ typedef struct AstExpr {
             struct AstExpr* body; // BlockStatment
             struct AstExpr* next; // Can be NULL
         } struct_declaration;
+        struct LazyBlock* lazy_block;
         struct ExternStatement {
             struct AstExpr* body; // BlockStatment / declaration / fn_declaration in global scope
             struct AstExpr* next; // Can be NULL
@@ -125,6 +172,14 @@ typedef struct AstExpr {
     };
 } AstExpr;
 
+// Errors in the parser and analyzer go through Ast_error. It prints and exits,
+// unless the thread set AST_ERROR_TRAP, then the message is kept in
+// AST_ERROR_MESSAGE and Ast_error longjmps there (see analyze_func_bodies)
+#define AST_ERROR_MESSAGE_SIZE 1024
+extern _Thread_local jmp_buf* AST_ERROR_TRAP;
+extern _Thread_local char AST_ERROR_MESSAGE[AST_ERROR_MESSAGE_SIZE];
+_Noreturn void Ast_error(const char* fmt, ...);
+
 int get_binding_power(Token opp);
 int is_opp(Token k);
 int is_unary(Token k);
@@ -133,7 +188,7 @@ AstExpr* parse_expr_statement(Lexer* lexer);
 AstExpr* parse_expr(Lexer* lexer, int curr_bp);
 AstExpr* parse_decl(Lexer* lexer);
 AstExpr* parse_func_decl(Lexer* lexer);
-AstExpr* parse_program(Lexer* lexer);
+AstExpr* parse_program(Lexer* lexer, Arena* arena);
 AstExpr* parse_arg_decl(Lexer* lexer);
 AstExpr* parse_args(Lexer* lexer);
 AstExpr* parse_statements(Lexer* lexer);
@@ -141,8 +196,21 @@ AstExpr* parse_statement(Lexer* lexer);
 AstExpr* parse_function_call(Lexer* lexer,Token ident);
 AstExpr* parse_unary(Lexer* lexer, Token opp);
 TypeInfo parse_type_info(Lexer* lexer);
+int top_level_item_end(Token* tokens, int tokens_len, int i);
 Type* parse_type(Lexer* lexer);
 
+AstExpr* Ast_new(Ast_ExprType type);
+AstExpr* Ast_next(AstExpr* stm);
+AstExpr* Ast_func_body(AstExpr* func);
+int Ast_func_reached(AstExpr* func);
+int Ast_func_cached(AstExpr* func);
+void Ast_set_body_arena(Arena* arena);
+Arena* Ast_program_arena(AstExpr* func);
+void Ast_mark_reachable(AstExpr* program);
+TypeId* Ast_type(AstExpr* node);
+void Ast_free_types();
+uint32_t Ast_nodes_num();
+uint32_t Ast_exprs_num();
 AstExpr* Ast_make_number(Token number);
 AstExpr* Ast_make_ident(Token ident);
 AstExpr* AST_make_binary(AstExpr* left, Token opp, AstExpr* right);
@@ -29,13 +29,11 @@ void print_statements(AstExpr* stm);
 void print_expr(AstExpr* expr);
 
 void print_args(AstExpr* arg) {
-    if( arg == NULL) {
-        printf("\b\b");
-        return;
-    } 
-    print_expr(arg->argument.value);
-    printf(", ");
-    print_args(arg->argument.next);
+    for( ; arg != NULL; arg = arg->argument.next ) {
+        print_expr(arg->argument.value);
+        printf(", ");
+    }
+    printf("\b\b");
 }
 
 void print_expr(AstExpr* expr) {
@@ -51,12 +49,12 @@ void print_expr(AstExpr* expr) {
             printf("%s",expr->identifier.token.value);
             return;
         case AST_STRING:
-            printf("\"%s\"",expr->identifier.token.value);
+            printf("\"%s\"",expr->string.token.value);
             return;
     }
     if( expr->type == AST_UNARY_OPERATION ) {
         printf("(");
-        switch (expr->unary_operation.opp_token.kind) {
+        switch (expr->unary_operation.opp) {
             case NOT:
                 printf("!"); break;
             case MINUS:
@@ -74,7 +72,7 @@ void print_expr(AstExpr* expr) {
     }
     if( expr->type == AST_BINARY_OPERATION ) {
         printf("(");
-        switch (expr->binary_operation.opp_token.kind) {
+        switch (expr->binary_operation.opp) {
             case PLUS:
                 printf("+"); break;
             case DIVITION:
@@ -102,7 +100,7 @@ void print_expr(AstExpr* expr) {
             case ASSIGN:
                 printf("="); break;
             default: 
-                PANIC("Oparation printing not supported: %s %s",format_enum(expr->binary_operation.opp_token),expr->binary_operation.opp_token.value);
+                PANIC("Oparation printing not supported: %s",format_enum((Token){ .kind = expr->binary_operation.opp }));
         }
         printf(" "); 
         print_expr(expr->binary_operation.left);
@@ -111,7 +109,7 @@ void print_expr(AstExpr* expr) {
         printf(")");
     } 
     if( expr->type == AST_FUNC_CALL ) {
-        printf("<Fn %s>{",expr->func_call.identifier.value);
+        printf("<Fn %s>{",expr->func_call.name);
         if( expr->func_call.args != NULL ){
             print_args(expr->func_call.args);
         }
@@ -143,22 +141,29 @@ void print_arg_decl(AstExpr* arg) {
 
 void print_func_decl(AstExpr* node) {
     StringBuilder sb = sb_new();
-    Type_build_type_string(&sb,node->function_declaration.return_type);
+    Type_build_type_string(&sb,node->function_declaration->return_type);
 
-    printf("func: name= {%s} return_type= {%s}\n",node->function_declaration.name,sb.buffer );
-    print_arg_decl(node->function_declaration.args);
+    printf("func: name= {%s} return_type= {%s}\n",node->function_declaration->name,sb.buffer );
+    print_arg_decl(node->function_declaration->args);
     // print body
     printf(" body= ");
-    print_statements(node->function_declaration.body);
+    if( Ast_func_cached(node) ) {
+        printf("{ reused from the incremental cache }");
+    } else if( Ast_func_reached(node) ) {
+        print_statements(Ast_func_body(node));
+    } else {
+        AstExpr* lazy = node->function_declaration->body;
+        printf("{ not reachable from main, %d tokens not parsed }",lazy->lazy_block->end - lazy->lazy_block->start + 1);
+    }
     printf("\n");
 }
 
 void print_decl(AstExpr* node) {
     StringBuilder sb = sb_new();
-    Type_build_type_string(&sb,node->declaration.type);
+    Type_build_type_string(&sb,node->declaration->type);
 
-    printf("decl: name= {%s} type= {%s} value= ", node->declaration.name, sb.buffer); 
-    print_statements(node->declaration.value);
+    printf("decl: name= {%s} type= {%s} value= ", node->declaration->name, sb.buffer); 
+    print_statements(node->declaration->value);
     printf("\n");
 }
 
@@ -171,13 +176,13 @@ void print_if(AstExpr* node) {
 }
 void print_for(AstExpr* node) {
     printf("for:\n\tinit = ");
-    print_statements(node->for_statement.initial);
+    print_statements(node->for_statement->initial);
     printf("\tcondition = ");
-    print_statements(node->for_statement.condition);
+    print_statements(node->for_statement->condition);
     printf("\n\titeration = ");
-    print_statements(node->for_statement.iteration);
+    print_statements(node->for_statement->iteration);
     printf("\n\tbody = ");
-    print_statements(node->for_statement.body);
+    print_statements(node->for_statement->body);
 }
 void print_while(AstExpr* node) {
     printf("\n\twhile: condition = ");
@@ -206,11 +211,11 @@ void print_statements(AstExpr* stm) {
         switch( next->type ) {
             case AST_FUNCTION_DECLARATION:
                 print_func_decl(next); 
-                next = next->function_declaration.next;
+                next = next->function_declaration->next;
                 break;
             case AST_DECLARATION:
                 print_decl(next); 
-                next = next->declaration.next;
+                next = next->declaration->next;
                 break;
             case AST_IF_STATEMENT:
                 print_if(next); 
@@ -218,7 +223,7 @@ void print_statements(AstExpr* stm) {
                 break;
             case AST_FOR_STATEMENT:
                 print_for(next); 
-                next = next->for_statement.next;
+                next = next->for_statement->next;
                 break;
             case AST_WHILE_STATEMENT:
                 print_while(next); 
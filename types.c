@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #define ASSERT(expr, fmt, ...) { \
     if (!expr) { \
@@ -20,20 +21,264 @@
 Type Type_new(char* type_name, TypeKind type_kind) {
     return (Type){ .type_name=type_name,.type_kind=type_kind };
 }
-Type Type_get_field_type(Type type,char* field_name) {
-    if( strcmp(field_name, "length") == 0 ) {
-        return Type_new("int",PRIMITIVE_TYPE);
+
+//Type Table
+// Interned types live in fixed size pages so a Type* stays valid while the
+// table grows, TypeId n is TYPE_PAGES[n / TYPE_PAGE_SIZE][n % TYPE_PAGE_SIZE].
+// Pointers and arrays are interned structurally (kind, sub_type, length),
+// all other kinds by kind and name.
+// Analyzer workers intern concurrently, Type_intern takes TYPE_LOCK and the
+// page directory never moves so Type_get needs no lock. Named types are only
+// added before the workers start.
+
+#define TYPE_PAGE_SIZE 256
+#define TYPE_PAGES_MAX (1 << 16)
+
+Type*    TYPE_PAGES[TYPE_PAGES_MAX];
+uint32_t TYPES_NUM      = 1; // TYPE_NONE is never handed out
+pthread_mutex_t TYPE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+TypeId*  TYPE_SLOTS     = NULL; // hash -> TypeId, TYPE_NONE = empty
+uint32_t TYPE_SLOTS_CAP = 0;    // power of 2
+
+// named types (primitives, structs), type_name -> TypeId
+TypeId*  NAMED_SLOTS     = NULL;
+uint32_t NAMED_SLOTS_CAP = 0;
+uint32_t NAMED_NUM       = 0;
+
+Type* Type_get(TypeId id) {
+    ASSERT( (id != TYPE_NONE && id < __atomic_load_n(&TYPES_NUM,__ATOMIC_ACQUIRE)) ,"%s %d: Invalid TypeId %u",__FILE__,__LINE__,id);
+    return &TYPE_PAGES[id / TYPE_PAGE_SIZE][id % TYPE_PAGE_SIZE];
+}
+
+static int type_is_structural(TypeKind kind) {
+    return kind == POINTER_TYPE || kind == ARRAY_TYPE;
+}
+
+static uint32_t type_hash(Type* type) {
+    uint64_t h = type->type_kind;
+    if( type_is_structural(type->type_kind) ) {
+        h = h * 31 + (uintptr_t)type->pointer_type.sub_type;
+        if( type->type_kind == ARRAY_TYPE ) {
+            h = h * 31 + (uint64_t)type->array_type.length;
+        }
+    } else {
+        h = h * 31 + (uintptr_t)type->type_name;
+    }
+    h *= 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(h >> 32);
+}
+
+static int type_same_key(Type* a, Type* b) {
+    if( a->type_kind != b->type_kind ) {
+        return 0;
+    }
+    switch( a->type_kind ) {
+        case POINTER_TYPE:
+            return a->pointer_type.sub_type == b->pointer_type.sub_type;
+        case ARRAY_TYPE:
+            return a->array_type.sub_type == b->array_type.sub_type &&
+                   a->array_type.length   == b->array_type.length;
+        default:
+            return a->type_name == b->type_name;
+    }
+}
+
+// slot of type in TYPE_SLOTS, TYPE_NONE there if type isnt interned
+static TypeId* type_slot(Type* type) {
+    uint32_t mask = TYPE_SLOTS_CAP - 1;
+    uint32_t i = type_hash(type) & mask;
+    while( TYPE_SLOTS[i] != TYPE_NONE && !type_same_key(Type_get(TYPE_SLOTS[i]),type) ) {
+        i = (i + 1) & mask;
+    }
+    return &TYPE_SLOTS[i];
+}
+
+static void type_grow_slots() {
+    free(TYPE_SLOTS);
+    TYPE_SLOTS_CAP = TYPE_SLOTS_CAP == 0 ? 256 : TYPE_SLOTS_CAP * 2;
+    TYPE_SLOTS = (TypeId*)calloc(TYPE_SLOTS_CAP,sizeof(TypeId));
+    ASSERT( (TYPE_SLOTS != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    for( TypeId id = 1; id < TYPES_NUM; id++ ) {
+        *type_slot(Type_get(id)) = id;
     }
-    ASSERT( (type.type_kind == STRUCT_TYPE), "Expected STRUCT_TYPE");
+}
 
-    FieldListNode* curr = type.struct_type.fields;
-    while( curr != NULL ) {
-        if( strcmp(curr->name,field_name) == 0 ) {
-            return curr->type;
+// Returns the id of the one interned copy of type, sub types have to be interned already.
+// Names have to be interned too.
+TypeId Type_intern(Type type) {
+    if( type_is_structural(type.type_kind) ) {
+        ASSERT( (type.pointer_type.sub_type != NULL && type.pointer_type.sub_type->id != TYPE_NONE) ,"%s %d: sub type not interned",__FILE__,__LINE__);
+    }
+    pthread_mutex_lock(&TYPE_LOCK);
+    if( (TYPES_NUM + 1) * 2 > TYPE_SLOTS_CAP ) {
+        type_grow_slots();
+    }
+    TypeId* slot = type_slot(&type);
+    if( *slot != TYPE_NONE ) {
+        TypeId id = *slot;
+        pthread_mutex_unlock(&TYPE_LOCK);
+        return id;
+    }
+
+    TypeId id = TYPES_NUM;
+    uint32_t page = id / TYPE_PAGE_SIZE;
+    ASSERT( (page < TYPE_PAGES_MAX) ,"%s %d: Too many types",__FILE__,__LINE__);
+    if( TYPE_PAGES[page] == NULL ) {
+        TYPE_PAGES[page] = (Type*)calloc(TYPE_PAGE_SIZE,sizeof(Type));
+        ASSERT( (TYPE_PAGES[page] != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+    }
+    type.id = id;
+    TYPE_PAGES[page][id % TYPE_PAGE_SIZE] = type;
+    *slot = id;
+    __atomic_store_n(&TYPES_NUM,id + 1,__ATOMIC_RELEASE);
+    pthread_mutex_unlock(&TYPE_LOCK);
+    return id;
+}
+
+TypeId Type_pointer_to(TypeId sub_type) {
+    Type type = Type_new(NULL,POINTER_TYPE);
+    type.pointer_type.sub_type = Type_get(sub_type);
+    return Type_intern(type);
+}
+
+TypeId Type_array_of(TypeId sub_type, long length) {
+    Type type = Type_new(NULL,ARRAY_TYPE);
+    type.array_type.sub_type = Type_get(sub_type);
+    type.array_type.length   = length;
+    return Type_intern(type);
+}
+
+static TypeId* named_slot(const char* type_name) {
+    uint32_t mask = NAMED_SLOTS_CAP - 1;
+    uint32_t i = Intern_hash(type_name) & mask;
+    while( NAMED_SLOTS[i] != TYPE_NONE && Type_get(NAMED_SLOTS[i])->type_name != type_name ) {
+        i = (i + 1) & mask;
+    }
+    return &NAMED_SLOTS[i];
+}
+
+// type_name has to be interned, TYPE_NONE if there is no such type
+TypeId Type_find_named(const char* type_name) {
+    if( NAMED_SLOTS_CAP == 0 ) {
+        return TYPE_NONE;
+    }
+    return *named_slot(type_name);
+}
+
+void Type_add_named(TypeId id) {
+    if( (NAMED_NUM + 1) * 2 > NAMED_SLOTS_CAP ) {
+        TypeId*  old     = NAMED_SLOTS;
+        uint32_t old_cap = NAMED_SLOTS_CAP;
+        NAMED_SLOTS_CAP = NAMED_SLOTS_CAP == 0 ? 64 : NAMED_SLOTS_CAP * 2;
+        NAMED_SLOTS = (TypeId*)calloc(NAMED_SLOTS_CAP,sizeof(TypeId));
+        ASSERT( (NAMED_SLOTS != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+        for( uint32_t i = 0; i < old_cap; i++ ) {
+            if( old[i] != TYPE_NONE ) {
+                *named_slot(Type_get(old[i])->type_name) = old[i];
+            }
         }
-        curr = curr->next;
+        free(old);
+    }
+    TypeId* slot = named_slot(Type_get(id)->type_name);
+    if( *slot == TYPE_NONE ) {
+        NAMED_NUM++;
+    }
+    *slot = id;
+}
+
+// Struct fields are stored in one allocation, the fields array in declaration
+// order followed by an open addressing index: field_name -> field number + 1,
+// 0 = empty. The index has a power of 2 capacity of at least 2*fields_num.
+
+static uint32_t field_index_cap(uint32_t fields_num) {
+    uint32_t cap = 4;
+    while( cap < fields_num * 2 ) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+static uint32_t* field_slot(StructField* fields, uint32_t fields_num, char* field_name) {
+    uint32_t* index = (uint32_t*)(fields + fields_num);
+    uint32_t mask = field_index_cap(fields_num) - 1;
+    uint32_t i = Intern_hash(field_name) & mask;
+    while( index[i] != 0 && fields[index[i]-1].name != field_name ) {
+        i = (i + 1) & mask;
+    }
+    return &index[i];
+}
+
+// Copies the fields, lays them out like a C compiler would (each field aligned
+// to its own alignment, size rounded up to the biggest one) and interns the struct.
+// Field names have to be interned.
+TypeId Type_make_struct(char* type_name, StructField* fields, uint32_t fields_num) {
+    Type type = Type_new(type_name,STRUCT_TYPE);
+    uint32_t index_cap = field_index_cap(fields_num);
+    StructField* copy = (StructField*)calloc(1,sizeof(StructField)*fields_num + sizeof(uint32_t)*index_cap);
+    ASSERT( (copy != NULL) ,"%s %d: MALLOC ERROR",__FILE__,__LINE__);
+
+    uint32_t offset = 0;
+    uint32_t align  = 1;
+    for( uint32_t n = 0; n < fields_num; n++ ) {
+        uint32_t field_align = Type_align(fields[n].type);
+        offset = (offset + field_align - 1) / field_align * field_align;
+        copy[n] = (StructField){ .type = fields[n].type, .offset = offset, .name = fields[n].name };
+        offset += Type_size(fields[n].type);
+        if( field_align > align ) {
+            align = field_align;
+        }
+
+        uint32_t* slot = field_slot(copy,fields_num,fields[n].name);
+        if( *slot != 0 ) {
+            PANIC("Duplicate field '%s' in struct {%s}",fields[n].name,type_name);
+        }
+        *slot = n + 1;
+    }
+
+    type.struct_type.fields     = copy;
+    type.struct_type.fields_num = fields_num;
+    type.struct_type.size       = (offset + align - 1) / align * align;
+    type.struct_type.align      = align;
+    return Type_intern(type);
+}
+
+// field_name has to be interned, NULL if the struct has no such field
+StructField* Type_find_field(TypeId type_id, char* field_name) {
+    Type* type = Type_get(type_id);
+    ASSERT( (type->type_kind == STRUCT_TYPE), "Expected STRUCT_TYPE");
+    if( type->struct_type.fields_num == 0 ) {
+        return NULL;
+    }
+    uint32_t field = *field_slot(type->struct_type.fields,type->struct_type.fields_num,field_name);
+    return field == 0 ? NULL : &type->struct_type.fields[field-1];
+}
+
+// size and alignment of a value of the type in the generated code,
+// arrays are passed around as __Array {void* data; int length;}
+uint32_t Type_size(TypeId type_id) {
+    Type* type = Type_get(type_id);
+    switch( type->type_kind ) {
+        case PRIMITIVE_TYPE:    return type->primitive_type.size;
+        case STRUCT_TYPE:       return type->struct_type.size;
+        case POINTER_TYPE:      return sizeof(void*);
+        case FUNCTION_TYPE:     return sizeof(void*);
+        case ARRAY_TYPE:        return 2 * sizeof(void*);
+        default:
+            PANIC("%s %d: Type {%s} has no size",__FILE__,__LINE__,type->type_name);
+    }
+}
+uint32_t Type_align(TypeId type_id) {
+    Type* type = Type_get(type_id);
+    switch( type->type_kind ) {
+        case PRIMITIVE_TYPE:    return type->primitive_type.align;
+        case STRUCT_TYPE:       return type->struct_type.align;
+        case POINTER_TYPE:
+        case FUNCTION_TYPE:
+        case ARRAY_TYPE:        return sizeof(void*);
+        default:
+            PANIC("%s %d: Type {%s} has no alignment",__FILE__,__LINE__,type->type_name);
     }
-    PANIC("Field not found '%s' in struct {%s}",field_name,type.type_name);
 }
 
 const char* Type_format_type_kind(Type type) {
@@ -60,27 +305,21 @@ char* format_type(Type type) {
     }
 }
 // 0 = NOT THE SAME, 1 = THE SAME, 2 ARR_DIFFRENT_LENGTH, 3 ARR_DIFFRENT_LENGTH_LEFT_NOT_SPECIFIED
-int Type_cmp(Type* type1, Type* type2) {
+// interned types are equal only if their ids are, pointers and arrays are
+// still walked to tell the array length mismatches apart
+int Type_cmp(TypeId type1_id, TypeId type2_id) {
+    if( type1_id == type2_id ) {
+        return 1;
+    }
+    Type* type1 = Type_get(type1_id);
+    Type* type2 = Type_get(type2_id);
     if( type1->type_kind != type2->type_kind ) {
         return 0;
     }
     switch( type1->type_kind ) {
-        case PRIMITIVE_TYPE:
-            if( strcmp(type1->type_name,type2->type_name) == 0 ) {
-                return 1;
-            } else {
-                return 0;
-            }
-        case STRUCT_TYPE:
-        case ENUM_TYPE:
-        case UNION_TYPE:
-            return 1;
         case POINTER_TYPE:
-            return Type_cmp(type1->pointer_type.sub_type,type2->pointer_type.sub_type);
+            return Type_cmp(type1->pointer_type.sub_type->id,type2->pointer_type.sub_type->id);
         case ARRAY_TYPE:
-            //if(type2->array_type.length == -1) {
-                //return 0;
-            //}
             if(type1->array_type.length != type2->array_type.length) {
                 if(type1->array_type.length == -1 ) {
                     return 3;
@@ -88,11 +327,11 @@ int Type_cmp(Type* type1, Type* type2) {
                     return 2;
                 }
             }
-            return Type_cmp(type1->array_type.sub_type,type2->array_type.sub_type);
+            return Type_cmp(type1->array_type.sub_type->id,type2->array_type.sub_type->id);
         case FUNCTION_TYPE:
             PANIC("Function types comparison is not implemented");
         default:
-            PANIC("%s %d:PANICKED",__FILE__,__LINE__);
+            return 0;
     }
 }
 
@@ -126,7 +365,7 @@ void Type_build_type_string(StringBuilder* sb, Type* type ){
             sb_append(sb,"( ");
             if( arg != NULL ) {
                 while(1) {
-                    Type_build_type_string(sb,&arg->type);
+                    Type_build_type_string(sb,Type_get(arg->type));
                     arg = arg->next; 
                     if( arg == NULL) 
                         break;
@@ -150,8 +389,8 @@ void Type_build_type_string(StringBuilder* sb, Type* type ){
             PANIC("%s %d:PANICKED",__FILE__,__LINE__);
     }
 }
-int Type_is_lvalue(Type* type){
-    switch( type->type_kind ) {
+int Type_is_lvalue(TypeId type){
+    switch( Type_get(type)->type_kind ) {
         case ARRAY_TYPE:
         case STRUCT_TYPE:
         case UNION_TYPE:
@@ -3,7 +3,11 @@
 #include <stdint.h>
 
 typedef struct TypeListNode TypeListNode;
-typedef struct FieldListNode FieldListNode;
+typedef struct StructField StructField;
+
+// Handle of an interned type, see Type_intern
+typedef uint32_t TypeId;
+#define TYPE_NONE 0
 
 typedef enum TypeKind {
     FUNCTION_TYPE,
@@ -23,8 +27,11 @@ typedef enum TypeKind {
 
 #define ARR_LEN_NOT_SPECIFIED 0 
 
+// Types built by the parser are plain trees, the analyzer interns them so every
+// structurally distinct type exists once and sub_type pointers point to interned types
 typedef struct Type {
     TypeKind type_kind;
+    TypeId id; // TYPE_NONE if not interned
     const char* type_name;
     union {
         struct FunctionType {
@@ -32,8 +39,15 @@ typedef struct Type {
             TypeListNode* arg_types;
         } function_type;
         struct StructType{
-            FieldListNode* fields;
+            StructField* fields; // in declaration order, followed by the name index, see Type_make_struct
+            uint32_t fields_num;
+            uint32_t size;
+            uint32_t align;
         } struct_type;
+        struct PrimitiveType{
+            uint32_t size;
+            uint32_t align;
+        } primitive_type;
         struct PointerType{
             struct Type* sub_type;
         } pointer_type;
@@ -44,22 +58,31 @@ typedef struct Type {
     };
 } Type;
 
-struct FieldListNode {
-    Type type;
+struct StructField {
+    TypeId type;
+    uint32_t offset; // bytes from the start of the struct
     char* name;
-    FieldListNode* next; // Can be NULL
 };
 
 struct TypeListNode {
-    Type type;
+    TypeId type;
     TypeListNode* next; // Can be NULL
 };
 
 Type Type_new(char* type_name, TypeKind type_kind);
-Type Type_get_field_type(Type type,char* field_name);
+TypeId Type_intern(Type type);
+Type* Type_get(TypeId id);
+TypeId Type_pointer_to(TypeId sub_type);
+TypeId Type_array_of(TypeId sub_type, long length);
+TypeId Type_find_named(const char* type_name);
+void Type_add_named(TypeId id);
+TypeId Type_make_struct(char* type_name, StructField* fields, uint32_t fields_num);
+StructField* Type_find_field(TypeId type, char* field_name);
+uint32_t Type_size(TypeId type);
+uint32_t Type_align(TypeId type);
 const char* Type_format_type_kind(Type type);
-int Type_cmp(Type* type1, Type* type2);
-int Type_is_lvalue(Type* type);
+int Type_cmp(TypeId type1, TypeId type2);
+int Type_is_lvalue(TypeId type);
 
 
 #include "my_string.h"
@@ -75,11 +98,11 @@ void Type_build_type_string(StringBuilder* sb, Type* type );
 
 //{.type_kind = PRIMITIVE_TYPE, .type_name = "bool"}, 
 #define PRIMITIVE_TYPES_ARRAY() { \
-    {.type_kind = PRIMITIVE_TYPE, .type_name = "float"}, \
-    {.type_kind = PRIMITIVE_TYPE, .type_name = "int"}, \
-    {.type_kind = PRIMITIVE_TYPE, .type_name = "void"}, \
-    {.type_kind = PRIMITIVE_TYPE, .type_name = "string"}, \
-    {.type_kind = PRIMITIVE_TYPE, .type_name = "char"}, \
+    {.type_kind = PRIMITIVE_TYPE, .type_name = "float",  .primitive_type = {4,4}}, \
+    {.type_kind = PRIMITIVE_TYPE, .type_name = "int",    .primitive_type = {4,4}}, \
+    {.type_kind = PRIMITIVE_TYPE, .type_name = "void",   .primitive_type = {0,1}}, \
+    {.type_kind = PRIMITIVE_TYPE, .type_name = "string", .primitive_type = {8,8}}, \
+    {.type_kind = PRIMITIVE_TYPE, .type_name = "char",   .primitive_type = {1,1}}, \
 }; \
 
 #endif